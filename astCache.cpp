@@ -0,0 +1,651 @@
+/*
+** astCache.cpp
+**
+** Layout of a .djast file:
+**
+**     "DJAST 1\n" <key> "\n"
+**     the symbol tables: classesST, then mainBlockST
+**     the program: its flags, the RTA and tail call results, mainExprs, then
+**     methodBodies
+**
+** Integers are LEB128 varints (signed ones zigzag encoded first), so most of
+** them take a single byte. Strings are a length, their bytes and a NUL. The
+** file is mapped once and never unmapped, and the char * fields of the symbol
+** tables point straight into the mapping. Every expression is a tag byte, the
+** fields all DJExpressions share, then its own fields and children in the
+** order they are declared in llast.hpp. Tag 0 is a null expression.
+**
+** A file that is truncated, corrupt or written for other sources is treated
+** like a missing one: the front end runs and the file is replaced.
+*/
+
+#include "astCache.hpp"
+#include "codegen.hpp"
+#include "sourceInput.hpp"
+#include "llvm/Support/MD5.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[] = "DJAST 1\n";
+
+enum ExpressionTag : unsigned char {
+  NullTag,
+  NatTag,
+  FalseTag,
+  TrueTag,
+  PlusTag,
+  MinusTag,
+  TimesTag,
+  PrintTag,
+  ReadTag,
+  NotTag,
+  EqualTag,
+  GreaterTag,
+  AndTag,
+  IfTag,
+  ForTag,
+  IdTag,
+  AssignTag,
+  NullLiteralTag,
+  NewTag,
+  DotIdTag,
+  DotAssignTag,
+  InstanceOfTag,
+  DotMethodCallTag,
+  ThisTag,
+  UndotMethodCallTag,
+};
+
+static ExpressionTag tagOf(DJExpression *e) {
+  static const std::map<std::string, ExpressionTag> tags = {
+      {"DJNat", NatTag},
+      {"DJFalse", FalseTag},
+      {"DJTrue", TrueTag},
+      {"DJPlus", PlusTag},
+      {"DJMinus", MinusTag},
+      {"DJTimes", TimesTag},
+      {"DJPrint", PrintTag},
+      {"DJRead", ReadTag},
+      {"DJNot", NotTag},
+      {"DJEqual", EqualTag},
+      {"DJGreater", GreaterTag},
+      {"DJAnd", AndTag},
+      {"DJIf", IfTag},
+      {"DJFor", ForTag},
+      {"DJId", IdTag},
+      {"DJAssign", AssignTag},
+      {"DJNull", NullLiteralTag},
+      {"DJNew", NewTag},
+      {"DJDotId", DotIdTag},
+      {"DJDotAssign", DotAssignTag},
+      {"DJInstanceOf", InstanceOfTag},
+      {"DJDotMethodCall", DotMethodCallTag},
+      {"DJThis", ThisTag},
+      {"DJUndotMethodCall", UndotMethodCallTag},
+  };
+  return e ? tags.at(e->className()) : NullTag;
+}
+
+class CacheWriter {
+public:
+  std::string out;
+
+  void unsignedInt(uint64_t value) {
+    do {
+      unsigned char byte = value & 0x7f;
+      value >>= 7;
+      out += (char)(byte | (value ? 0x80 : 0));
+    } while (value);
+  }
+
+  void signedInt(int64_t value) {
+    unsignedInt(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+  }
+
+  void string(const std::string &value) {
+    unsignedInt(value.size());
+    out.append(value.c_str(), value.size() + 1);
+  }
+
+  void varDecls(const VarDecl *vars, int count) {
+    unsignedInt(count);
+    for (int i = 0; i < count; i++) {
+      string(vars[i].varName);
+      signedInt(vars[i].varNameLineNumber);
+      signedInt(vars[i].type);
+      signedInt(vars[i].typeLineNumber);
+    }
+  }
+
+  void expressions(const ExprList &exprs) {
+    unsignedInt(exprs.size());
+    for (auto e : exprs) {
+      expression(e);
+    }
+  }
+
+  void expression(DJExpression *e) {
+    auto tag = tagOf(e);
+    out += (char)tag;
+    if (tag == NullTag) {
+      return;
+    }
+    unsignedInt(e->lineNumber);
+    unsignedInt(e->hasNullChild);
+    signedInt(e->nullChildCount);
+    signedInt(e->staticClassNum);
+    string(e->staticClassName);
+    signedInt(e->staticMemberNum);
+    string(e->staticMemberName);
+    switch (tag) {
+    case NatTag:
+      unsignedInt(((DJNat *)e)->value);
+      break;
+    case PlusTag:
+      expression(((DJPlus *)e)->lhs);
+      expression(((DJPlus *)e)->rhs);
+      break;
+    case MinusTag:
+      expression(((DJMinus *)e)->lhs);
+      expression(((DJMinus *)e)->rhs);
+      break;
+    case TimesTag:
+      expression(((DJTimes *)e)->lhs);
+      expression(((DJTimes *)e)->rhs);
+      break;
+    case GreaterTag:
+      expression(((DJGreater *)e)->lhs);
+      expression(((DJGreater *)e)->rhs);
+      break;
+    case AndTag:
+      expression(((DJAnd *)e)->lhs);
+      expression(((DJAnd *)e)->rhs);
+      break;
+    case EqualTag: {
+      auto equal = (DJEqual *)e;
+      expression(equal->lhs);
+      expression(equal->rhs);
+      unsignedInt(equal->bothNull);
+      unsignedInt(equal->leftNull);
+      unsignedInt(equal->rightNull);
+      signedInt(equal->nonNullType);
+      break;
+    }
+    case PrintTag:
+      expression(((DJPrint *)e)->printee);
+      break;
+    case NotTag:
+      expression(((DJNot *)e)->negated);
+      break;
+    case IfTag:
+      expression(((DJIf *)e)->cond);
+      expressions(((DJIf *)e)->thenBlock);
+      expressions(((DJIf *)e)->elseBlock);
+      break;
+    case ForTag:
+      expression(((DJFor *)e)->init);
+      expression(((DJFor *)e)->test);
+      expression(((DJFor *)e)->update);
+      expressions(((DJFor *)e)->body);
+      break;
+    case IdTag:
+      string(((DJId *)e)->ID);
+      break;
+    case AssignTag:
+      string(((DJAssign *)e)->LHS);
+      signedInt(((DJAssign *)e)->LHSType);
+      expression(((DJAssign *)e)->RHS);
+      break;
+    case NewTag:
+      string(((DJNew *)e)->assignee);
+      signedInt(((DJNew *)e)->classID);
+      break;
+    case DotIdTag:
+      expression(((DJDotId *)e)->objectLike);
+      string(((DJDotId *)e)->ID);
+      break;
+    case DotAssignTag:
+      expression(((DJDotAssign *)e)->objectLike);
+      string(((DJDotAssign *)e)->ID);
+      expression(((DJDotAssign *)e)->assignVal);
+      break;
+    case InstanceOfTag:
+      expression(((DJInstanceOf *)e)->objectLike);
+      signedInt(((DJInstanceOf *)e)->classID);
+      break;
+    case DotMethodCallTag: {
+      auto call = (DJDotMethodCall *)e;
+      expression(call->objectLike);
+      string(call->methodName);
+      expression(call->methodParameter);
+      string(call->paramName);
+      signedInt(call->paramDeclaredType);
+      unsignedInt(call->isTailCall);
+      signedInt(call->targetClass);
+      signedInt(call->targetMethod);
+      break;
+    }
+    case UndotMethodCallTag: {
+      auto call = (DJUndotMethodCall *)e;
+      string(call->methodName);
+      expression(call->methodParameter);
+      string(call->paramName);
+      signedInt(call->paramDeclaredType);
+      unsignedInt(call->isTailCall);
+      signedInt(call->targetClass);
+      signedInt(call->targetMethod);
+      break;
+    }
+    default:
+      break;
+    }
+  }
+};
+
+class CacheReader {
+public:
+  const char *next, *end;
+  // cleared by the first read past the end or malformed value; everything
+  // read after that is zero or empty
+  bool ok = true;
+
+  CacheReader(const char *begin, const char *end) : next(begin), end(end) {}
+
+  uint64_t unsignedInt() {
+    uint64_t value = 0;
+    for (int shift = 0; ok && shift < 64; shift += 7) {
+      if (next == end) {
+        break;
+      }
+      unsigned char byte = *next++;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    ok = false;
+    return 0;
+  }
+
+  int64_t signedInt() {
+    auto value = unsignedInt();
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+  }
+
+  const char *string() {
+    auto size = unsignedInt();
+    if (!ok || size >= (uint64_t)(end - next) || next[size] != '\0') {
+      ok = false;
+      return "";
+    }
+    auto value = next;
+    next += size + 1;
+    return value;
+  }
+
+  // read a count of things that each take at least one byte, so that a
+  // corrupt count cannot make us allocate more than the file could hold
+  uint64_t count() {
+    auto value = unsignedInt();
+    if (value > (uint64_t)(end - next)) {
+      ok = false;
+      return 0;
+    }
+    return value;
+  }
+
+  VarDecl *varDecls(int &count) {
+    count = this->count();
+    auto vars = new VarDecl[count]();
+    for (int i = 0; i < count; i++) {
+      vars[i].varName = (char *)string();
+      vars[i].varNameLineNumber = signedInt();
+      vars[i].type = signedInt();
+      vars[i].typeLineNumber = signedInt();
+    }
+    return vars;
+  }
+
+  ExprList expressions() {
+    ExprList exprs;
+    auto size = count();
+    for (uint64_t i = 0; ok && i < size; i++) {
+      exprs.push_back(expression());
+    }
+    return exprs;
+  }
+
+  DJExpression *expression() {
+    if (!ok || next == end) {
+      ok = false;
+      return nullptr;
+    }
+    auto tag = (ExpressionTag)*next++;
+    if (tag == NullTag) {
+      return nullptr;
+    }
+    auto lineNumber = unsignedInt();
+    bool hasNullChild = unsignedInt();
+    int nullChildCount = signedInt();
+    int staticClassNum = signedInt();
+    std::string staticClassName = string();
+    int staticMemberNum = signedInt();
+    std::string staticMemberName = string();
+    DJExpression *e = nullptr;
+    switch (tag) {
+    case NatTag:
+      e = new DJNat(unsignedInt());
+      break;
+    case FalseTag:
+      e = new DJFalse();
+      break;
+    case TrueTag:
+      e = new DJTrue();
+      break;
+    case PlusTag: {
+      auto lhs = expression();
+      e = new DJPlus(lhs, expression());
+      break;
+    }
+    case MinusTag: {
+      auto lhs = expression();
+      e = new DJMinus(lhs, expression());
+      break;
+    }
+    case TimesTag: {
+      auto lhs = expression();
+      e = new DJTimes(lhs, expression());
+      break;
+    }
+    case GreaterTag: {
+      auto lhs = expression();
+      e = new DJGreater(lhs, expression());
+      break;
+    }
+    case AndTag: {
+      auto lhs = expression();
+      e = new DJAnd(lhs, expression());
+      break;
+    }
+    case EqualTag: {
+      auto lhs = expression();
+      auto equal = new DJEqual(lhs, expression());
+      equal->bothNull = unsignedInt();
+      equal->leftNull = unsignedInt();
+      equal->rightNull = unsignedInt();
+      equal->nonNullType = signedInt();
+      e = equal;
+      break;
+    }
+    case PrintTag:
+      e = new DJPrint(expression());
+      break;
+    case ReadTag:
+      e = new DJRead();
+      break;
+    case NotTag:
+      e = new DJNot(expression());
+      break;
+    case IfTag: {
+      auto cond = expression();
+      auto thenBlock = expressions();
+      e = new DJIf(cond, thenBlock, expressions());
+      break;
+    }
+    case ForTag: {
+      auto init = expression();
+      auto test = expression();
+      auto update = expression();
+      e = new DJFor(init, test, update, expressions());
+      break;
+    }
+    case IdTag:
+      e = new DJId((char *)string());
+      break;
+    case AssignTag: {
+      auto LHS = (char *)string();
+      int LHSType = signedInt();
+      e = new DJAssign(LHS, LHSType, expression());
+      break;
+    }
+    case NullLiteralTag:
+      e = new DJNull();
+      break;
+    case NewTag: {
+      auto assignee = (char *)string();
+      e = new DJNew(assignee, signedInt());
+      break;
+    }
+    case DotIdTag: {
+      auto objectLike = expression();
+      e = new DJDotId(objectLike, (char *)string());
+      break;
+    }
+    case DotAssignTag: {
+      auto objectLike = expression();
+      auto ID = (char *)string();
+      e = new DJDotAssign(objectLike, ID, expression());
+      break;
+    }
+    case InstanceOfTag: {
+      auto objectLike = expression();
+      e = new DJInstanceOf(objectLike, signedInt());
+      break;
+    }
+    case DotMethodCallTag: {
+      auto objectLike = expression();
+      std::string methodName = string();
+      auto methodParameter = expression();
+      std::string paramName = string();
+      int paramDeclaredType = signedInt();
+      auto call = new DJDotMethodCall(objectLike, methodName, methodParameter,
+                                      paramName, paramDeclaredType);
+      call->isTailCall = unsignedInt();
+      call->targetClass = signedInt();
+      call->targetMethod = signedInt();
+      e = call;
+      break;
+    }
+    case ThisTag:
+      e = new DJThis();
+      break;
+    case UndotMethodCallTag: {
+      std::string methodName = string();
+      auto methodParameter = expression();
+      std::string paramName = string();
+      int paramDeclaredType = signedInt();
+      auto call = new DJUndotMethodCall(methodName, methodParameter, paramName,
+                                        paramDeclaredType);
+      call->isTailCall = unsignedInt();
+      call->targetClass = signedInt();
+      call->targetMethod = signedInt();
+      e = call;
+      break;
+    }
+    default:
+      ok = false;
+      return nullptr;
+    }
+    e->lineNumber = lineNumber;
+    e->hasNullChild = hasNullChild;
+    e->nullChildCount = nullChildCount;
+    e->staticClassNum = staticClassNum;
+    e->staticClassName = staticClassName;
+    e->staticMemberNum = staticMemberNum;
+    e->staticMemberName = staticMemberName;
+    return e;
+  }
+};
+
+std::string astCacheKey(const std::string &frontEndFlags) {
+  auto text = sourceText();
+  llvm::MD5 Hash;
+  Hash.update(frontEndFlags);
+  Hash.update(llvm::StringRef(text.first, text.second));
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  return Result.digest().str().str();
+}
+
+void saveASTCache(const std::string &path, const std::string &key,
+                  const DJProgram &program) {
+  CacheWriter writer;
+  writer.out = magic + key + "\n";
+  writer.unsignedInt(numClasses);
+  for (int i = 0; i < numClasses; i++) {
+    auto &classST = classesST[i];
+    writer.string(classST.className);
+    writer.signedInt(classST.classNameLineNumber);
+    writer.signedInt(classST.superclass);
+    writer.signedInt(classST.superclassLineNumber);
+    writer.varDecls(classST.staticVarList, classST.numStaticVars);
+    writer.varDecls(classST.varList, classST.numVars);
+    writer.unsignedInt(classST.numMethods);
+    for (int j = 0; j < classST.numMethods; j++) {
+      auto &methodST = classST.methodList[j];
+      writer.string(methodST.methodName);
+      writer.signedInt(methodST.methodNameLineNumber);
+      writer.signedInt(methodST.returnType);
+      writer.signedInt(methodST.returnTypeLineNumber);
+      writer.string(methodST.paramName);
+      writer.signedInt(methodST.paramNameLineNumber);
+      writer.signedInt(methodST.paramType);
+      writer.signedInt(methodST.paramTypeLineNumber);
+      writer.varDecls(methodST.localST, methodST.numLocals);
+    }
+  }
+  writer.varDecls(mainBlockST, numMainBlockLocals);
+
+  writer.unsignedInt(program.hasInstanceOf);
+  writer.unsignedInt(program.hasPrintNat);
+  writer.unsignedInt(program.hasReadNat);
+  writer.unsignedInt(program.pruneUnreachable);
+  writer.unsignedInt(program.instantiatedClasses.size());
+  for (auto classNum : program.instantiatedClasses) {
+    writer.signedInt(classNum);
+  }
+  writer.unsignedInt(program.reachableMethods.size());
+  for (auto method : program.reachableMethods) {
+    writer.signedInt(method.first);
+    writer.signedInt(method.second);
+  }
+  writer.unsignedInt(program.selfTailRecursive.size());
+  for (const auto &name : program.selfTailRecursive) {
+    writer.string(name);
+  }
+  writer.expressions(program.mainExprs);
+  writer.unsignedInt(program.methodBodies.size());
+  for (const auto &body : program.methodBodies) {
+    writer.string(body.first);
+    writer.expressions(body.second);
+  }
+
+  // write next to the cache and rename over it, so that a compile running at
+  // the same time never maps half a file
+  auto temporary = path + ".tmp";
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (!file) {
+    printf("WARNING: could not write %s\n", temporary.c_str());
+    return;
+  }
+  bool wrote = fwrite(writer.out.data(), 1, writer.out.size(), file) ==
+               writer.out.size();
+  if (fclose(file) != 0 || !wrote ||
+      rename(temporary.c_str(), path.c_str()) != 0) {
+    printf("WARNING: could not write %s\n", path.c_str());
+    unlink(temporary.c_str());
+  }
+}
+
+bool loadASTCache(const std::string &path, const std::string &key,
+                  DJProgram &program) {
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  const char *begin = (const char *)map;
+  auto header = magic + key + "\n";
+  if ((size_t)st.st_size < header.size() ||
+      memcmp(begin, header.data(), header.size()) != 0) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  CacheReader reader(begin + header.size(), begin + st.st_size);
+
+  // decode into locals, so a corrupt file leaves the globals untouched
+  int classes = reader.count();
+  auto classTables = new ClassDecl[classes]();
+  for (int i = 0; i < classes && reader.ok; i++) {
+    auto &classST = classTables[i];
+    classST.className = (char *)reader.string();
+    classST.classNameLineNumber = reader.signedInt();
+    classST.superclass = reader.signedInt();
+    classST.superclassLineNumber = reader.signedInt();
+    classST.staticVarList = reader.varDecls(classST.numStaticVars);
+    classST.varList = reader.varDecls(classST.numVars);
+    classST.numMethods = reader.count();
+    classST.methodList = new MethodDecl[classST.numMethods]();
+    for (int j = 0; j < classST.numMethods; j++) {
+      auto &methodST = classST.methodList[j];
+      methodST.methodName = (char *)reader.string();
+      methodST.methodNameLineNumber = reader.signedInt();
+      methodST.returnType = reader.signedInt();
+      methodST.returnTypeLineNumber = reader.signedInt();
+      methodST.paramName = (char *)reader.string();
+      methodST.paramNameLineNumber = reader.signedInt();
+      methodST.paramType = reader.signedInt();
+      methodST.paramTypeLineNumber = reader.signedInt();
+      methodST.localST = reader.varDecls(methodST.numLocals);
+      // the bodies are only ever read as ASTrees by translateAST
+      methodST.bodyExprs = nullptr;
+    }
+  }
+  int mainLocals;
+  auto mainTable = reader.varDecls(mainLocals);
+
+  DJProgram loaded(ExprList{});
+  loaded.hasInstanceOf = reader.unsignedInt();
+  loaded.hasPrintNat = reader.unsignedInt();
+  loaded.hasReadNat = reader.unsignedInt();
+  loaded.pruneUnreachable = reader.unsignedInt();
+  for (auto n = reader.count(); reader.ok && n > 0; n--) {
+    loaded.instantiatedClasses.insert(reader.signedInt());
+  }
+  for (auto n = reader.count(); reader.ok && n > 0; n--) {
+    int classNum = reader.signedInt();
+    loaded.reachableMethods.insert({classNum, reader.signedInt()});
+  }
+  for (auto n = reader.count(); reader.ok && n > 0; n--) {
+    loaded.selfTailRecursive.insert(reader.string());
+  }
+  loaded.mainExprs = reader.expressions();
+  for (auto n = reader.count(); reader.ok && n > 0; n--) {
+    std::string name = reader.string();
+    loaded.methodBodies[name] = reader.expressions();
+  }
+  if (!reader.ok || reader.next != reader.end) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  numClasses = classes;
+  classesST = classTables;
+  numMainBlockLocals = mainLocals;
+  mainBlockST = mainTable;
+  program = loaded;
+  return true;
+}
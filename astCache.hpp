@@ -0,0 +1,23 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+/*--ast-cache: the typed symbol tables (classesST, mainBlockST) and the LLAST
+ * as it stands after simplifyProgram, rapidTypeAnalysis and markTailCalls,
+ * saved in a compact binary file. a later compile of the same sources with
+ * the same front-end flags maps that file and goes straight to codeGen*/
+
+#include "llast.hpp"
+#include <string>
+
+// identifies the sources and every flag that changes the front end's output;
+// call it before yyparse, while sourceText() is still intact
+std::string astCacheKey(const std::string &frontEndFlags);
+
+// fills in the symbol tables and program and returns true when path holds a
+// cache for key; returns false, changing nothing, otherwise
+bool loadASTCache(const std::string &path, const std::string &key,
+                  DJProgram &program);
+
+void saveASTCache(const std::string &path, const std::string &key,
+                  const DJProgram &program);
+
+#endif // __ASTCACHE_H_
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+
+import os
+import subprocess
+import sys
+import time
+
+# each configuration is a name and the dj2ll flags that produce it
+configurations = [("unoptimized", []), ("optimized", ["--run-optis"])]
+
+runs = 5
+
+# --startup: each --link profile, and the program whose startup it times
+link_profiles = ["default", "nopie", "static", "gc", "strip", "prelink",
+                 "static,gc,strip"]
+startup_program = "startup.dj"
+startup_runs = 1000
+
+
+def compile_program(file, flags):
+    fileName = f"bench_programs/{file}"
+    result = subprocess.run(["./dj2ll", fileName] + flags)
+    if result.returncode != 0:
+        return None
+    return f"./{file[0:-3]}"
+
+
+def time_program(executable):
+    # best of `runs` wall-clock times, in seconds
+    best = None
+    output = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        result = subprocess.run([executable], stdin=subprocess.DEVNULL,
+                                stdout=subprocess.PIPE)
+        elapsed = time.perf_counter() - start
+        output = result.stdout.decode().strip()
+        if best is None or elapsed < best:
+            best = elapsed
+    return best, output
+
+
+def time_startup(executable):
+    # mean wall-clock time of `startup_runs` runs, in seconds. the program
+    # does next to nothing, so this is the cost of exec, loading, relocation
+    # and runtime setup. posix_spawn keeps Python's own overhead out of it
+    devnull = os.open(os.devnull, os.O_RDWR)
+    actions = [(os.POSIX_SPAWN_DUP2, devnull, 0),
+               (os.POSIX_SPAWN_DUP2, devnull, 1)]
+    start = time.perf_counter()
+    for _ in range(startup_runs):
+        pid = os.posix_spawn(executable, [executable], {},
+                             file_actions=actions)
+        os.waitpid(pid, 0)
+    elapsed = time.perf_counter() - start
+    os.close(devnull)
+    return elapsed / startup_runs
+
+
+def startup():
+    lines = []
+    for profile in link_profiles:
+        flags = ["--run-optis"]
+        if profile != "default":
+            flags.append(f"--link={profile}")
+        executable = compile_program(startup_program, flags)
+        if executable is None:
+            lines.append(f"{profile:<16} failed to compile")
+        else:
+            seconds = time_startup(executable)
+            size = os.path.getsize(executable)
+            lines.append(f"{profile:<16} {seconds * 1e6:10.1f} us/run "
+                         f"{size / 1024:10.1f} KiB")
+            os.remove(executable)
+        print(lines[-1])
+    with open("bench_output.txt", "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def main():
+    if sys.argv[1:] == ["--startup"]:
+        startup()
+        return
+    if len(sys.argv) == 1:
+        files = sorted([f for f in os.listdir("bench_programs")
+                        if f.startswith("bench")])
+    else:
+        files = sys.argv[1:]
+    lines = []
+    for file in files:
+        for name, flags in configurations:
+            executable = compile_program(file, flags)
+            if executable is None:
+                lines.append(f"{file:<12} {name:<12} failed to compile")
+            else:
+                seconds, output = time_program(executable)
+                lines.append(f"{file:<12} {name:<12} "
+                             f"{seconds * 1000:10.2f} ms   output: {output}")
+                os.remove(executable)
+            print(lines[-1])
+    with open("bench_output.txt", "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,794 @@
+/*
+** bytecode.cpp
+**
+** Every method, and main, becomes a BytecodeFunction: a flat array of 8-byte
+** instructions over a frame of 64-bit registers. A method's frame holds
+** `this` in r0, its parameter in r1 and its locals after that. main's frame
+** starts with its locals. Temporaries come after the named registers and are
+** handed out in stack order, so one expression's temporaries are reused by
+** the next. A register holds a nat, a bool (0 or 1), or an object pointer.
+**
+** Everything codeGen looks up in classesST by name is resolved once, here:
+**
+**     * static fields become slots in one array, found the same way codeGen
+**       finds their globals (varIsStaticInAnySuperClass)
+**     * fields become indices into the object, superclass fields first
+**       (getIndexOfRegularOrInheritedField). an object is its class number
+**       followed by its fields
+**     * for every method, a dispatch table maps each dynamic class to the
+**       method a call runs, picked by getDynamicMethodInfo like the VTable
+**       thunks pick theirs
+**     * instanceof reads a numClasses x numClasses table of isSubtype
+**
+** The interpreter is one function that jumps from instruction to instruction
+** through a table of label addresses (computed goto). Calls push a frame on
+** an explicit stack instead of recursing, and calls that markTailCalls found
+** in tail position replace the caller's frame, so tail recursion runs in
+** constant space as it does in the compiled program. readNat() and null
+** dereferences go through dj_read_nat and dj_null_deref from runtime.c, so
+** input and errors behave the same as in a compiled program.
+**
+** With --tiered, every call the interpreter makes and every backward jump
+** it takes warms up the function it lands in. A function that reaches the
+** threshold is queued for BytecodeJIT, and calls to it go to the native code
+** from the moment that is published. main is never compiled, since it only
+** runs once and there is no way to move a running frame to native code. The
+** native code keeps the interpreter's objects and static slots, and calls
+** back in through the bytecode* functions below for calls, allocation and
+** printing, so the two tiers can call each other freely. Calls from native
+** code run on the C stack, which is checked against its limit.
+*/
+
+#include "bytecode.hpp"
+#include "bytecodeJIT.hpp"
+#include "codeGenClass.hpp"
+#include "runtime.h"
+#include "sourceInput.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+static std::map<std::pair<int, int>, unsigned int> functionIndices;
+
+static void tooLarge(const std::string &what) {
+  printf("ERROR: %s is too large for --interpret\n", what.c_str());
+  exit(-1);
+}
+
+static bool assigns(DJExpression *e, const std::string &name) {
+  // whether evaluating e can store to the local called name
+  if (auto assign = dynamic_cast<DJAssign *>(e)) {
+    if (assign->LHS == name) {
+      return true;
+    }
+  }
+  for (auto child : e->children()) {
+    if (assigns(child, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool isLeaf(DJExpression *e) {
+  // expressions that write their register once, after reading everything
+  return dynamic_cast<DJNat *>(e) || dynamic_cast<DJTrue *>(e) ||
+         dynamic_cast<DJFalse *>(e) || dynamic_cast<DJNull *>(e) ||
+         dynamic_cast<DJId *>(e) || dynamic_cast<DJThis *>(e) ||
+         dynamic_cast<DJRead *>(e);
+}
+
+class FunctionCompiler {
+public:
+  BytecodeProgram &program;
+  BytecodeFunction &function;
+  std::map<std::string, uint16_t> locals;
+  int classNum; // -1 in main
+  unsigned int nextRegister = 0;
+
+  FunctionCompiler(BytecodeProgram &program, BytecodeFunction &function,
+                   int classNum)
+      : program(program), function(function), classNum(classNum) {}
+
+  void local(const std::string &name) {
+    locals[name] = temporary();
+  }
+
+  uint16_t temporary() {
+    if (nextRegister > UINT16_MAX) {
+      tooLarge(function.name);
+    }
+    function.numRegisters = std::max(function.numRegisters, nextRegister + 1);
+    return nextRegister++;
+  }
+
+  size_t emit(Opcode op, unsigned a = 0, unsigned b = 0, unsigned c = 0,
+              unsigned int line = 0) {
+    if (line != 0) {
+      function.lines[function.code.size()] = line;
+    }
+    function.code.push_back({op, (uint16_t)a, (uint16_t)b, (uint16_t)c});
+    return function.code.size() - 1;
+  }
+
+  size_t emitImm(Opcode op, unsigned a, uint32_t imm) {
+    return emit(op, a, imm & 0xffff, imm >> 16);
+  }
+
+  void jumpHere(size_t jump) {
+    auto target = (uint32_t)function.code.size();
+    function.code[jump].b = target & 0xffff;
+    function.code[jump].c = target >> 16;
+  }
+
+  void move(uint16_t into, uint16_t from) {
+    if (into != from) {
+      emit(OP_MOVE, into, from);
+    }
+  }
+
+  unsigned int staticSlot(const std::string &ID, int inClass) {
+    // -1 when ID is not a static field of inClass or its superclasses
+    if (inClass <= 0) {
+      return -1;
+    }
+    auto varInfo = varIsStaticInAnySuperClass(ID, inClass);
+    if (!varInfo.first) {
+      return -1;
+    }
+    return program.staticSlots[varInfo.second + "." + ID];
+  }
+
+  unsigned int fieldIndex(const std::string &ID, int inClass) {
+    return getIndexOfRegularOrInheritedField(ID, inClass);
+  }
+
+  uint16_t operand(DJExpression *e, DJExpression *evaluatedFirst) {
+    // the register holding e's value. a local is read in place, unless
+    // evaluatedFirst, which runs between here and the read, may assign it
+    if (auto id = dynamic_cast<DJId *>(e)) {
+      auto found = locals.find(id->ID);
+      if (found != locals.end() &&
+          (!evaluatedFirst || !assigns(evaluatedFirst, id->ID))) {
+        return found->second;
+      }
+    }
+    auto into = temporary();
+    compile(e, into);
+    return into;
+  }
+
+  void compileBlock(const ExprList &exprs, uint16_t into) {
+    if (exprs.empty()) {
+      emitImm(OP_LOADK, into, 0);
+      return;
+    }
+    auto mark = nextRegister;
+    auto scratch = exprs.size() > 1 ? temporary() : into;
+    for (size_t i = 0; i + 1 < exprs.size(); i++) {
+      compile(exprs[i], scratch);
+    }
+    compile(exprs.back(), into);
+    nextRegister = mark;
+  }
+
+  void binary(Opcode op, DJExpression *lhs, DJExpression *rhs,
+              uint16_t into) {
+    auto a = operand(lhs, rhs);
+    auto b = operand(rhs, nullptr);
+    emit(op, into, a, b);
+  }
+
+  void call(DJExpression *receiver, DJExpression *parameter, bool isTailCall,
+            int staticClass, int staticMethod, uint16_t into,
+            unsigned int line) {
+    auto callee = functionIndices[{staticClass, staticMethod}];
+    if (callee > UINT16_MAX) {
+      tooLarge("the program");
+    }
+    auto base = temporary();
+    temporary();
+    if (receiver) {
+      compile(receiver, base);
+    } else {
+      move(base, 0); // `this`
+    }
+    compile(parameter, base + 1);
+    if (isTailCall && classNum >= 0) {
+      emit(OP_TAILCALL, 0, base, callee, line);
+    } else {
+      emit(OP_CALL, into, base, callee, line);
+    }
+  }
+
+  void compile(DJExpression *e, uint16_t into) {
+    // leaves e's value in register into; temporaries are freed afterwards
+    auto mark = nextRegister;
+    if (auto nat = dynamic_cast<DJNat *>(e)) {
+      emitImm(OP_LOADK, into, nat->value);
+    } else if (dynamic_cast<DJTrue *>(e)) {
+      emitImm(OP_LOADK, into, 1);
+    } else if (dynamic_cast<DJFalse *>(e) || dynamic_cast<DJNull *>(e)) {
+      emitImm(OP_LOADK, into, 0);
+    } else if (auto plus = dynamic_cast<DJPlus *>(e)) {
+      binary(OP_ADD, plus->lhs, plus->rhs, into);
+    } else if (auto minus = dynamic_cast<DJMinus *>(e)) {
+      binary(OP_SUB, minus->lhs, minus->rhs, into);
+    } else if (auto times = dynamic_cast<DJTimes *>(e)) {
+      binary(OP_MUL, times->lhs, times->rhs, into);
+    } else if (auto equal = dynamic_cast<DJEqual *>(e)) {
+      binary(OP_EQ, equal->lhs, equal->rhs, into);
+    } else if (auto greater = dynamic_cast<DJGreater *>(e)) {
+      binary(OP_GT, greater->lhs, greater->rhs, into);
+    } else if (auto print = dynamic_cast<DJPrint *>(e)) {
+      compile(print->printee, into);
+      emit(OP_PRINT, into);
+    } else if (dynamic_cast<DJRead *>(e)) {
+      emit(OP_READ, into);
+    } else if (auto negation = dynamic_cast<DJNot *>(e)) {
+      compile(negation->negated, into);
+      emit(OP_NOT, into, into);
+    } else if (auto conjunction = dynamic_cast<DJAnd *>(e)) {
+      // short-circuits: into already holds false when we skip the rhs
+      compile(conjunction->lhs, into);
+      auto skip = emitImm(OP_JMPF, into, 0);
+      compile(conjunction->rhs, into);
+      jumpHere(skip);
+    } else if (auto ifExpr = dynamic_cast<DJIf *>(e)) {
+      auto cond = operand(ifExpr->cond, nullptr);
+      auto toElse = emitImm(OP_JMPF, cond, 0);
+      compileBlock(ifExpr->thenBlock, into);
+      auto toEnd = emitImm(OP_JMP, 0, 0);
+      jumpHere(toElse);
+      compileBlock(ifExpr->elseBlock, into);
+      jumpHere(toEnd);
+    } else if (auto forExpr = dynamic_cast<DJFor *>(e)) {
+      auto scratch = temporary();
+      compile(forExpr->init, scratch);
+      auto top = (uint32_t)function.code.size();
+      auto test = operand(forExpr->test, nullptr);
+      auto exit = emitImm(OP_JMPF, test, 0);
+      compileBlock(forExpr->body, scratch);
+      compile(forExpr->update, scratch);
+      emitImm(OP_JMP, 0, top);
+      jumpHere(exit);
+      // a for loop's value is always 0
+      emitImm(OP_LOADK, into, 0);
+    } else if (auto id = dynamic_cast<DJId *>(e)) {
+      auto found = locals.find(id->ID);
+      auto slot = staticSlot(id->ID, classNum);
+      if (found != locals.end()) {
+        move(into, found->second);
+      } else if (slot != (unsigned int)-1) {
+        emitImm(OP_GETSTATIC, into, slot);
+      } else {
+        emit(OP_GETFIELD, into, 0, fieldIndex(id->ID, classNum));
+      }
+    } else if (auto assign = dynamic_cast<DJAssign *>(e)) {
+      auto found = locals.find(assign->LHS);
+      auto slot = staticSlot(assign->LHS, classNum);
+      if (found != locals.end()) {
+        if (isLeaf(assign->RHS)) {
+          compile(assign->RHS, found->second);
+        } else {
+          auto value = temporary();
+          compile(assign->RHS, value);
+          move(found->second, value);
+        }
+        move(into, found->second);
+      } else if (slot != (unsigned int)-1) {
+        compile(assign->RHS, into);
+        emitImm(OP_PUTSTATIC, into, slot);
+      } else {
+        compile(assign->RHS, into);
+        emit(OP_PUTFIELD, 0, fieldIndex(assign->LHS, classNum), into);
+      }
+    } else if (auto newExpr = dynamic_cast<DJNew *>(e)) {
+      emitImm(OP_NEW, into, newExpr->classID);
+    } else if (auto dotId = dynamic_cast<DJDotId *>(e)) {
+      // like codeGen, a static field is read without evaluating the object
+      auto slot = staticSlot(dotId->ID, dotId->staticClassNum);
+      if (slot != (unsigned int)-1) {
+        emitImm(OP_GETSTATIC, into, slot);
+      } else {
+        auto object = operand(dotId->objectLike, nullptr);
+        emit(OP_GETFIELD, into, object,
+             fieldIndex(dotId->ID, dotId->staticClassNum), e->lineNumber);
+      }
+    } else if (auto dotAssign = dynamic_cast<DJDotAssign *>(e)) {
+      // the value is evaluated before the object, as in codeGen
+      auto slot = staticSlot(dotAssign->ID, dotAssign->staticClassNum);
+      compile(dotAssign->assignVal, into);
+      if (slot != (unsigned int)-1) {
+        emitImm(OP_PUTSTATIC, into, slot);
+      } else {
+        auto object = operand(dotAssign->objectLike, nullptr);
+        emit(OP_PUTFIELD, object,
+             fieldIndex(dotAssign->ID, dotAssign->staticClassNum), into,
+             e->lineNumber);
+      }
+    } else if (auto instanceOf = dynamic_cast<DJInstanceOf *>(e)) {
+      auto object = operand(instanceOf->objectLike, nullptr);
+      emit(OP_INSTANCEOF, into, object, instanceOf->classID);
+    } else if (auto dotCall = dynamic_cast<DJDotMethodCall *>(e)) {
+      call(dotCall->objectLike, dotCall->methodParameter, dotCall->isTailCall,
+           dotCall->staticClassNum, dotCall->staticMemberNum, into,
+           e->lineNumber);
+    } else if (dynamic_cast<DJThis *>(e)) {
+      move(into, 0);
+    } else if (auto undotCall = dynamic_cast<DJUndotMethodCall *>(e)) {
+      call(nullptr, undotCall->methodParameter, undotCall->isTailCall,
+           undotCall->staticClassNum, undotCall->staticMemberNum, into,
+           e->lineNumber);
+    }
+    nextRegister = mark;
+  }
+};
+
+static int fieldType(const std::string &ID, int classNum) {
+  for (int count = 0; count < numClasses && classNum > 0; count++) {
+    auto &classST = classesST[classNum];
+    for (int i = 0; i < classST.numStaticVars; i++) {
+      if (ID == classST.staticVarList[i].varName) {
+        return classST.staticVarList[i].type;
+      }
+    }
+    for (int i = 0; i < classST.numVars; i++) {
+      if (ID == classST.varList[i].varName) {
+        return classST.varList[i].type;
+      }
+    }
+    classNum = classST.superclass;
+  }
+  return BAD_TYPE;
+}
+
+static int mainExpressionType(DJExpression *e) {
+  // the DJ type of an expression of the main block, as far as main's exit
+  // status is concerned: codeGen returns main's last value only if it is an
+  // i32
+  if (dynamic_cast<DJTrue *>(e) || dynamic_cast<DJFalse *>(e) ||
+      dynamic_cast<DJNot *>(e) || dynamic_cast<DJEqual *>(e) ||
+      dynamic_cast<DJGreater *>(e) || dynamic_cast<DJAnd *>(e) ||
+      dynamic_cast<DJInstanceOf *>(e)) {
+    return TYPE_BOOL;
+  }
+  if (dynamic_cast<DJNew *>(e)) {
+    return OBJECT_TYPE;
+  }
+  if (auto id = dynamic_cast<DJId *>(e)) {
+    for (int i = 0; i < numMainBlockLocals; i++) {
+      if (id->ID == mainBlockST[i].varName) {
+        return mainBlockST[i].type;
+      }
+    }
+  }
+  if (auto assign = dynamic_cast<DJAssign *>(e)) {
+    return assign->LHSType;
+  }
+  if (auto dotId = dynamic_cast<DJDotId *>(e)) {
+    return fieldType(dotId->ID, dotId->staticClassNum);
+  }
+  if (auto dotAssign = dynamic_cast<DJDotAssign *>(e)) {
+    return fieldType(dotAssign->ID, dotAssign->staticClassNum);
+  }
+  if (auto ifExpr = dynamic_cast<DJIf *>(e)) {
+    return ifExpr->thenBlock.empty()
+               ? TYPE_NAT
+               : mainExpressionType(ifExpr->thenBlock.back());
+  }
+  if (dynamic_cast<DJDotMethodCall *>(e) ||
+      dynamic_cast<DJUndotMethodCall *>(e)) {
+    return classesST[e->staticClassNum]
+        .methodList[e->staticMemberNum]
+        .returnType;
+  }
+  // nats, and null, which codeGen makes an i32 0 when its type is unknown
+  return TYPE_NAT;
+}
+
+static void compileProgram(DJProgram &program, BytecodeProgram &bytecode) {
+  functionIndices.clear();
+  bytecode.functions.emplace_back();
+  bytecode.functions[0].name = "main";
+  for (int i = 0; i < numClasses; i++) {
+    for (int j = 0; j < classesST[i].numMethods; j++) {
+      functionIndices[{i, j}] = bytecode.functions.size();
+      bytecode.functions.emplace_back();
+      bytecode.functions.back().name =
+          std::string(classesST[i].className) + "." +
+          classesST[i].methodList[j].methodName;
+    }
+  }
+
+  for (int i = 0; i < numClasses; i++) {
+    for (int j = 0; j < classesST[i].numStaticVars; j++) {
+      auto name = std::string(classesST[i].className) + "." +
+                  classesST[i].staticVarList[j].varName;
+      auto slot = (unsigned int)bytecode.staticSlots.size();
+      bytecode.staticSlots[name] = slot;
+    }
+    int fields = 0;
+    for (int c = i, count = 0; c > 0 && count < numClasses; count++) {
+      fields += classesST[c].numVars;
+      c = classesST[c].superclass;
+    }
+    bytecode.numFields.push_back(fields);
+    for (int j = 0; j < numClasses; j++) {
+      bytecode.subtypes.push_back(isSubtype(i, j));
+    }
+  }
+
+  bytecode.dispatch.resize(bytecode.functions.size());
+  for (const auto &method : functionIndices) {
+    auto [staticClass, staticMethod] = method.first;
+    auto &targets = bytecode.dispatch[method.second];
+    targets.assign(numClasses, -1);
+    for (int j = 1; j < numClasses; j++) {
+      if (isSubtype(j, staticClass)) {
+        targets[j] = functionIndices[getDynamicMethodInfo(staticClass, j,
+                                                          staticMethod)];
+      }
+    }
+  }
+
+  FunctionCompiler main(bytecode, bytecode.functions[0], -1);
+  for (int i = 0; i < numMainBlockLocals; i++) {
+    main.local(mainBlockST[i].varName);
+  }
+  auto result = main.temporary();
+  main.compileBlock(program.mainExprs, result);
+  if (program.mainExprs.empty() ||
+      mainExpressionType(program.mainExprs.back()) != TYPE_NAT) {
+    main.emitImm(OP_LOADK, result, 0);
+  }
+  main.emit(OP_RET, result);
+
+  for (const auto &method : functionIndices) {
+    auto [classNum, methodNum] = method.first;
+    auto &methodST = classesST[classNum].methodList[methodNum];
+    auto name = std::string(classesST[classNum].className) + "_method_" +
+                methodST.methodName;
+    FunctionCompiler compiler(bytecode, bytecode.functions[method.second],
+                              classNum);
+    compiler.local("this");
+    compiler.local(methodST.paramName);
+    for (int i = 0; i < methodST.numLocals; i++) {
+      compiler.local(methodST.localST[i].varName);
+    }
+    auto result = compiler.temporary();
+    compiler.compileBlock(program.methodBodies[name], result);
+    compiler.emit(OP_RET, result);
+  }
+}
+
+
+// the register stack may grow to this many registers (1 GiB) before the
+// program is considered to have recursed without bound
+static const size_t maxRegisters = (size_t)1 << 27;
+
+struct Machine {
+  const BytecodeProgram &program;
+  std::vector<uint64_t> statics;
+  std::vector<uint64_t> registers;
+  // the first register no running interpreter loop uses; where a call from
+  // native code back into the interpreter puts its frames
+  size_t top = 0;
+  // --tiered only
+  std::unique_ptr<std::atomic<NativeFunction>[]> natives;
+  std::vector<unsigned int> heat;
+  unsigned int jitThreshold = 0;
+  std::unique_ptr<BytecodeJIT> jit;
+  // calls from native code stop this many bytes below stackBase
+  uintptr_t stackBase = 0;
+  size_t stackLimit = 0;
+
+  Machine(const BytecodeProgram &program)
+      : program(program), statics(program.staticSlots.size()),
+        registers(1 << 16),
+        natives(new std::atomic<NativeFunction>[program.functions.size()]),
+        heat(program.functions.size()) {
+    for (size_t i = 0; i < program.functions.size(); i++) {
+      natives[i] = nullptr;
+    }
+  }
+};
+
+static Machine *machine;
+
+struct Frame {
+  const BytecodeFunction *function;
+  const Instruction *resume;
+  size_t base;
+  uint16_t result;
+};
+
+static void warmUp(size_t function) {
+  if (machine->jit && function != 0 &&
+      ++machine->heat[function] == machine->jitThreshold) {
+    machine->jit->compileLater(function);
+  }
+}
+
+[[noreturn]] static void nullDereference(const BytecodeFunction *function,
+                                         const Instruction *pc) {
+  // let the compile thread finish before exit tears LLVM down
+  machine->jit.reset();
+  auto line = function->lines.find(pc - function->code.data());
+  dj_null_deref(line == function->lines.end()
+                    ? 0
+                    : sourceLine(line->second).second,
+                function->name.c_str());
+}
+
+[[noreturn]] static void stackExhausted(const BytecodeFunction *function) {
+  machine->jit.reset();
+  fflush(stdout);
+  fprintf(stderr, "stack exhausted at method %s\n", function->name.c_str());
+  exit(EXIT_FAILURE);
+}
+
+#define FIELDS(object) ((uint64_t *)(uintptr_t)(object) + 1)
+#define CLASS_OF(object) (*(uint64_t *)(uintptr_t)(object))
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+static uint64_t run(size_t entry, uint64_t receiver, uint64_t parameter) {
+  // runs function entry, and everything it calls that is not native, to
+  // completion
+  static void *const labels[] = {
+      &&op_loadk,      &&op_move,      &&op_add,        &&op_sub,
+      &&op_mul,        &&op_eq,        &&op_gt,         &&op_not,
+      &&op_jmp,        &&op_jmpf,      &&op_print,      &&op_read,
+      &&op_getstatic,  &&op_putstatic, &&op_getfield,   &&op_putfield,
+      &&op_new,        &&op_instanceof, &&op_call,      &&op_tailcall,
+      &&op_ret,
+  };
+  Machine &m = *machine;
+  const BytecodeProgram &program = m.program;
+  const size_t classes = program.numFields.size();
+  const size_t entryTop = m.top;
+  std::vector<Frame> frames;
+  const BytecodeFunction *function = nullptr;
+  const BytecodeFunction *callee = &program.functions[entry];
+  const Instruction *pc = nullptr;
+  size_t base = 0;
+  size_t calleeBase = m.top;
+  uint64_t *r = nullptr;
+  uint64_t returned = 0;
+  NativeFunction native;
+  int target;
+
+#define DISPATCH() goto *labels[pc->op]
+#define NEXT()                                                                 \
+  do {                                                                         \
+    ++pc;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+
+  goto enter;
+op_loadk:
+  r[pc->a] = pc->imm();
+  NEXT();
+op_move:
+  r[pc->a] = r[pc->b];
+  NEXT();
+op_add:
+  r[pc->a] = (uint32_t)(r[pc->b] + r[pc->c]);
+  NEXT();
+op_sub:
+  r[pc->a] = (uint32_t)(r[pc->b] - r[pc->c]);
+  NEXT();
+op_mul:
+  r[pc->a] = (uint32_t)(r[pc->b] * r[pc->c]);
+  NEXT();
+op_eq:
+  r[pc->a] = r[pc->b] == r[pc->c];
+  NEXT();
+op_gt:
+  r[pc->a] = r[pc->b] > r[pc->c];
+  NEXT();
+op_not:
+  r[pc->a] = !r[pc->b];
+  NEXT();
+op_jmp:
+  if (pc->imm() <= (size_t)(pc - function->code.data())) {
+    // a loop iteration
+    warmUp(function - program.functions.data());
+  }
+  pc = function->code.data() + pc->imm();
+  DISPATCH();
+op_jmpf:
+  if (!r[pc->a]) {
+    pc = function->code.data() + pc->imm();
+    DISPATCH();
+  }
+  NEXT();
+op_print:
+  printf("%u\n", (uint32_t)r[pc->a]);
+  NEXT();
+op_read:
+  r[pc->a] = dj_read_nat(program.prompt);
+  NEXT();
+op_getstatic:
+  r[pc->a] = m.statics[pc->imm()];
+  NEXT();
+op_putstatic:
+  m.statics[pc->imm()] = r[pc->a];
+  NEXT();
+op_getfield:
+  if (!r[pc->b]) {
+    nullDereference(function, pc);
+  }
+  r[pc->a] = FIELDS(r[pc->b])[pc->c];
+  NEXT();
+op_putfield:
+  if (!r[pc->a]) {
+    nullDereference(function, pc);
+  }
+  FIELDS(r[pc->a])[pc->b] = r[pc->c];
+  NEXT();
+op_new:
+  r[pc->a] = bytecodeNew(pc->imm());
+  NEXT();
+op_instanceof:
+  r[pc->a] = r[pc->b] && program.subtypes[CLASS_OF(r[pc->b]) * classes + pc->c];
+  NEXT();
+op_call:
+op_tailcall:
+  receiver = r[pc->b];
+  parameter = r[pc->b + 1];
+  if (!receiver) {
+    nullDereference(function, pc);
+  }
+  target = program.dispatch[pc->c][CLASS_OF(receiver)];
+  if (target < 0) {
+    // no method for this receiver; the VTable thunk returns 0 or null
+    returned = 0;
+  } else if ((native = m.natives[target].load(std::memory_order_acquire))) {
+    m.top = base + function->numRegisters;
+    returned = native(receiver, parameter);
+    // calls back into the interpreter may have grown the registers
+    r = m.registers.data() + base;
+  } else {
+    warmUp(target);
+    callee = &program.functions[target];
+    calleeBase = base;
+    if (pc->op == OP_CALL) {
+      frames.push_back({function, pc + 1, base, pc->a});
+      calleeBase = base + function->numRegisters;
+    }
+    goto enter;
+  }
+  if (pc->op == OP_TAILCALL) {
+    goto return_value;
+  }
+  r[pc->a] = returned;
+  NEXT();
+op_ret:
+  returned = r[pc->a];
+return_value:
+  if (frames.empty()) {
+    m.top = entryTop;
+    return returned;
+  }
+  base = frames.back().base;
+  function = frames.back().function;
+  pc = frames.back().resume;
+  r = m.registers.data() + base;
+  r[frames.back().result] = returned;
+  frames.pop_back();
+  DISPATCH();
+enter:
+  // start callee at calleeBase with receiver and parameter
+  if (calleeBase + callee->numRegisters > m.registers.size()) {
+    if (calleeBase + callee->numRegisters > maxRegisters) {
+      stackExhausted(callee);
+    }
+    m.registers.resize(
+        std::min(maxRegisters, 2 * (calleeBase + callee->numRegisters)));
+  }
+  function = callee;
+  base = calleeBase;
+  r = m.registers.data() + base;
+  std::fill(r, r + function->numRegisters, 0);
+  if (function != &program.functions[0]) {
+    r[0] = receiver;
+    r[1] = parameter;
+  }
+  pc = function->code.data();
+  DISPATCH();
+#undef DISPATCH
+#undef NEXT
+}
+#pragma GCC diagnostic pop
+
+uint64_t bytecodeCall(uint32_t function, uint32_t pc, uint64_t receiver,
+                      uint64_t parameter) {
+  const auto &program = machine->program;
+  const auto *instruction = &program.functions[function].code[pc];
+  if (!receiver) {
+    nullDereference(&program.functions[function], instruction);
+  }
+  int target = program.dispatch[instruction->c][CLASS_OF(receiver)];
+  if (target < 0) {
+    return 0;
+  }
+  char here;
+  if (machine->stackBase - (uintptr_t)&here > machine->stackLimit) {
+    stackExhausted(&program.functions[target]);
+  }
+  auto native = machine->natives[target].load(std::memory_order_acquire);
+  if (native) {
+    return native(receiver, parameter);
+  }
+  warmUp(target);
+  return run(target, receiver, parameter);
+}
+
+void bytecodeNullDereference(uint32_t function, uint32_t pc) {
+  const auto &program = machine->program;
+  nullDereference(&program.functions[function],
+                  &program.functions[function].code[pc]);
+}
+
+uint64_t bytecodeNew(uint32_t classNum) {
+  auto object = (uint64_t *)calloc(1 + machine->program.numFields[classNum],
+                                   sizeof(uint64_t));
+  if (!object) {
+    perror("dj2ll");
+    exit(EXIT_FAILURE);
+  }
+  object[0] = classNum;
+  return (uintptr_t)object;
+}
+
+uint64_t bytecodeInstanceOf(uint64_t object, uint32_t classNum) {
+  const auto &program = machine->program;
+  return object && program.subtypes[CLASS_OF(object) *
+                                        program.numFields.size() +
+                                    classNum];
+}
+
+void bytecodePrint(uint64_t value) { printf("%u\n", (uint32_t)value); }
+
+uint64_t bytecodeRead() { return dj_read_nat(machine->program.prompt); }
+
+#undef FIELDS
+#undef CLASS_OF
+
+int interpretProgram(DJProgram &program, bool promptOnRead,
+                     unsigned int jitThreshold) {
+  BytecodeProgram bytecode;
+  bytecode.prompt = promptOnRead;
+  compileProgram(program, bytecode);
+  Machine m(bytecode);
+  machine = &m;
+  if (jitThreshold != 0) {
+    m.jitThreshold = jitThreshold;
+    m.jit = std::make_unique<BytecodeJIT>(bytecode, m.statics.data(),
+                                          m.natives.get());
+    // leave a quarter of the C stack, and at least 256 KiB, for whatever
+    // the deepest call from native code goes on to do
+    char here;
+    rlimit limit;
+    size_t size = 8 << 20;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+      size = limit.rlim_cur;
+    }
+    m.stackBase = (uintptr_t)&here;
+    m.stackLimit = size - std::max<size_t>(size / 4, 256 << 10);
+  }
+  auto status = (uint32_t)run(0, 0, 0);
+  m.jit.reset();
+  machine = nullptr;
+  return (int)status;
+}
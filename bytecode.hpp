@@ -0,0 +1,85 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+/*--interpret: compiles the LLAST to a compact register bytecode and runs it
+ * right away, without LLVM, an object file or a link. meant for short
+ * programs and test runs, where starting LLVM costs more than the program.
+ * --tiered runs the same bytecode, and hands the methods that turn out to be
+ * hot to bytecodeJIT.cpp*/
+
+#include "llast.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum Opcode : uint16_t {
+  OP_LOADK,      // a = imm
+  OP_MOVE,       // a = b
+  OP_ADD,        // a = b + c, as a nat
+  OP_SUB,        // a = b - c, as a nat
+  OP_MUL,        // a = b * c, as a nat
+  OP_EQ,         // a = b == c
+  OP_GT,         // a = b > c
+  OP_NOT,        // a = !b
+  OP_JMP,        // go to imm
+  OP_JMPF,       // go to imm if a is false
+  OP_PRINT,      // printNat(a)
+  OP_READ,       // a = readNat()
+  OP_GETSTATIC,  // a = statics[imm]
+  OP_PUTSTATIC,  // statics[imm] = a
+  OP_GETFIELD,   // a = b.fields[c]
+  OP_PUTFIELD,   // a.fields[b] = c
+  OP_NEW,        // a = new imm
+  OP_INSTANCEOF, // a = b instanceof c
+  OP_CALL,       // a = b.(method c)(b + 1)
+  OP_TAILCALL,   // return b.(method c)(b + 1)
+  OP_RET,        // return a
+};
+
+struct Instruction {
+  uint16_t op, a, b, c;
+  // the instructions with a 32-bit operand keep it in b and c
+  uint32_t imm() const { return b | (uint32_t)c << 16; }
+};
+
+struct BytecodeFunction {
+  std::string name; // "C.m", or "main"
+  std::vector<Instruction> code;
+  // the DJ line of every GETFIELD, PUTFIELD and CALL, for null reports
+  std::map<size_t, unsigned int> lines;
+  unsigned int numRegisters = 0;
+};
+
+struct BytecodeProgram {
+  // main first, then every method in classesST order
+  std::vector<BytecodeFunction> functions;
+  // for the function of each method: the function a call runs, indexed by
+  // the receiver's class; -1 where the VTable would fall through to 0
+  std::vector<std::vector<int>> dispatch;
+  std::map<std::string, unsigned int> staticSlots; // "C.x"
+  std::vector<unsigned int> numFields;             // by class
+  std::vector<uint8_t> subtypes;                   // [sub * numClasses + super]
+  bool prompt = true;
+};
+
+// a method compiled by bytecodeJIT.cpp, called with `this` and its parameter
+typedef uint64_t (*NativeFunction)(uint64_t, uint64_t);
+
+// runs the program and returns the exit status the compiled program would
+// have had: main's value when it is a nat, and 0 otherwise. with a nonzero
+// jitThreshold, a method is compiled to native code once its calls and loop
+// iterations add up to that many
+int interpretProgram(DJProgram &program, bool promptOnRead,
+                     unsigned int jitThreshold = 0);
+
+// what code compiled by bytecodeJIT.cpp calls for the instructions it does not
+// do inline. function and pc locate the instruction, for null reports
+uint64_t bytecodeCall(uint32_t function, uint32_t pc, uint64_t receiver,
+                      uint64_t parameter);
+[[noreturn]] void bytecodeNullDereference(uint32_t function, uint32_t pc);
+uint64_t bytecodeNew(uint32_t classNum);
+uint64_t bytecodeInstanceOf(uint64_t object, uint32_t classNum);
+void bytecodePrint(uint64_t value);
+uint64_t bytecodeRead();
+
+#endif // __BYTECODE_H_
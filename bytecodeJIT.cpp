@@ -0,0 +1,322 @@
+/*
+** bytecodeJIT.cpp
+**
+** Translates one BytecodeFunction at a time to LLVM IR and compiles it with
+** ORC's LLJIT. Each function gets its own module and context, built,
+** optimized with optimizeModule and compiled on the worker thread, so the
+** interpreter never waits for LLVM.
+**
+** The IR works on the interpreter's data rather than codeGen's: registers are
+** i64 allocas (promoted by mem2reg), objects are the interpreter's
+** [class, fields...] arrays, and static fields are the interpreter's slots,
+** whose addresses are baked in as constants. Calls, allocation, instanceof,
+** printNat() and readNat() call back into bytecode.cpp through absolute
+** function addresses, so the JIT never has to resolve a symbol. A call goes
+** through bytecodeCall, which dispatches and runs the callee either natively
+** or in the interpreter; that is what lets a native function call one that
+** is not hot yet. Field accesses and arithmetic are inline. A tail call that
+** dispatches back to the function itself jumps to its start instead, so that
+** self tail recursion runs in constant stack space in this tier too.
+*/
+
+#include "bytecodeJIT.hpp"
+#include "codegen.hpp"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include <set>
+
+using namespace llvm;
+
+BytecodeJIT::BytecodeJIT(const BytecodeProgram &program, uint64_t *statics,
+                         std::atomic<NativeFunction> *natives)
+    : program(program), statics(statics), natives(natives) {}
+
+BytecodeJIT::~BytecodeJIT() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void BytecodeJIT::compileLater(size_t function) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(function);
+  }
+  if (!worker.joinable()) {
+    worker = std::thread(&BytecodeJIT::work, this);
+  }
+  wake.notify_one();
+}
+
+void BytecodeJIT::work() {
+  // short runs never get here, so this is the first time LLVM is touched
+  TM = createTargetMachine();
+  auto created = orc::LLJITBuilder().create();
+  if (!created) {
+    // keep interpreting
+    logAllUnhandledErrors(created.takeError(), errs(), "dj2ll: ");
+    return;
+  }
+  jit = std::move(*created);
+  while (true) {
+    size_t function;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+      function = queue.front();
+      queue.pop_front();
+    }
+    if (auto native = compile(function)) {
+      natives[function].store(native, std::memory_order_release);
+    }
+  }
+}
+
+template <typename T>
+static Constant *address(Type *type, T *pointer) {
+  // pointer, as a constant of the given pointer type
+  return ConstantExpr::getIntToPtr(
+      ConstantInt::get(Type::getInt64Ty(type->getContext()),
+                       (uintptr_t)pointer),
+      type);
+}
+
+NativeFunction BytecodeJIT::compile(size_t index) {
+  const BytecodeFunction &function = program.functions[index];
+  auto Context = std::make_unique<LLVMContext>();
+  auto &C = *Context;
+  auto M = std::make_unique<Module>(function.name, C);
+  M->setDataLayout(jit->getDataLayout());
+  M->setTargetTriple(jit->getTargetTriple().str());
+  IRBuilder<> B(C);
+  auto i1 = B.getInt1Ty();
+  auto i32 = B.getInt32Ty();
+  auto i64 = B.getInt64Ty();
+  auto i64Ptr = i64->getPointerTo();
+  auto voidTy = B.getVoidTy();
+
+  auto callType = FunctionType::get(i64, {i32, i32, i64, i64}, false);
+  auto nullType = FunctionType::get(voidTy, {i32, i32}, false);
+  auto newType = FunctionType::get(i64, {i32}, false);
+  auto instanceOfType = FunctionType::get(i64, {i64, i32}, false);
+  auto printType = FunctionType::get(voidTy, {i64}, false);
+  auto readType = FunctionType::get(i64, {}, false);
+
+  auto F = Function::Create(FunctionType::get(i64, {i64, i64}, false),
+                            Function::ExternalLinkage, function.name, M.get());
+  B.SetInsertPoint(BasicBlock::Create(C, "entry", F));
+  std::vector<AllocaInst *> registers;
+  for (unsigned int i = 0; i < function.numRegisters; i++) {
+    registers.push_back(B.CreateAlloca(i64));
+    B.CreateStore(B.getInt64(0), registers.back());
+  }
+  B.CreateStore(F->getArg(0), registers[0]);
+  B.CreateStore(F->getArg(1), registers[1]);
+
+  // a block starts at every jump target and after every jump and return, and
+  // at the start, which self tail calls jump back to
+  const auto &code = function.code;
+  std::set<size_t> leaders = {0};
+  for (size_t pc = 0; pc < code.size(); pc++) {
+    auto op = code[pc].op;
+    if (op == OP_JMP || op == OP_JMPF) {
+      leaders.insert(code[pc].imm());
+    }
+    if (op == OP_JMP || op == OP_JMPF || op == OP_RET || op == OP_TAILCALL) {
+      leaders.insert(pc + 1);
+    }
+  }
+  std::map<size_t, BasicBlock *> blocks;
+  for (auto pc : leaders) {
+    if (pc < code.size()) {
+      blocks[pc] = BasicBlock::Create(C, "pc" + std::to_string(pc), F);
+    }
+  }
+
+  auto get = [&](uint16_t reg) -> Value * {
+    return B.CreateLoad(i64, registers[reg]);
+  };
+  auto set = [&](uint16_t reg, Value *value) {
+    if (value->getType() == i1) {
+      value = B.CreateZExt(value, i64);
+    }
+    B.CreateStore(value, registers[reg]);
+  };
+  auto nat = [&](Value *value) { return B.CreateTrunc(value, i32); };
+  auto checkNull = [&](Value *object, size_t pc) {
+    auto isNull = BasicBlock::Create(C, "isnull", F);
+    auto notNull = BasicBlock::Create(C, "notnull", F);
+    B.CreateCondBr(B.CreateIsNull(object), isNull, notNull);
+    B.SetInsertPoint(isNull);
+    auto report = B.CreateCall(nullType, address(nullType->getPointerTo(),
+                                                 &bytecodeNullDereference),
+                               {B.getInt32(index), B.getInt32(pc)});
+    report->setDoesNotReturn();
+    B.CreateUnreachable();
+    B.SetInsertPoint(notNull);
+  };
+  auto jumpBackIfSelf = [&](Value *receiver, Value *parameter,
+                            uint16_t method, size_t pc) {
+    // for the receiver classes whose call would dispatch to this function,
+    // start it over instead, with every register but `this` and the
+    // parameter cleared as a call would. the others fall through to the call
+    const auto &targets = program.dispatch[method];
+    std::vector<uint64_t> selfClasses;
+    for (size_t classNum = 0; classNum < targets.size(); classNum++) {
+      if (targets[classNum] == (int)index) {
+        selfClasses.push_back(classNum);
+      }
+    }
+    if (selfClasses.empty()) {
+      return;
+    }
+    checkNull(receiver, pc);
+    auto self = BasicBlock::Create(C, "selftail", F);
+    auto other = BasicBlock::Create(C, "call", F);
+    auto classNum = B.CreateLoad(i64, B.CreateIntToPtr(receiver, i64Ptr));
+    auto dispatch = B.CreateSwitch(classNum, other, selfClasses.size());
+    for (auto selfClass : selfClasses) {
+      dispatch->addCase(B.getInt64(selfClass), self);
+    }
+    B.SetInsertPoint(self);
+    for (size_t reg = 2; reg < registers.size(); reg++) {
+      B.CreateStore(B.getInt64(0), registers[reg]);
+    }
+    B.CreateStore(receiver, registers[0]);
+    B.CreateStore(parameter, registers[1]);
+    B.CreateBr(blocks[0]);
+    B.SetInsertPoint(other);
+  };
+  auto field = [&](Value *object, uint16_t field) {
+    return B.CreateInBoundsGEP(i64, B.CreateIntToPtr(object, i64Ptr),
+                               B.getInt64(1 + field));
+  };
+
+  for (size_t pc = 0; pc < code.size(); pc++) {
+    if (blocks.count(pc)) {
+      if (!B.GetInsertBlock()->getTerminator()) {
+        B.CreateBr(blocks[pc]);
+      }
+      B.SetInsertPoint(blocks[pc]);
+    }
+    const auto &I = code[pc];
+    switch (I.op) {
+    case OP_LOADK:
+      set(I.a, B.getInt64(I.imm()));
+      break;
+    case OP_MOVE:
+      set(I.a, get(I.b));
+      break;
+    case OP_ADD:
+      set(I.a, B.CreateZExt(B.CreateAdd(nat(get(I.b)), nat(get(I.c))), i64));
+      break;
+    case OP_SUB:
+      set(I.a, B.CreateZExt(B.CreateSub(nat(get(I.b)), nat(get(I.c))), i64));
+      break;
+    case OP_MUL:
+      set(I.a, B.CreateZExt(B.CreateMul(nat(get(I.b)), nat(get(I.c))), i64));
+      break;
+    case OP_EQ:
+      set(I.a, B.CreateICmpEQ(get(I.b), get(I.c)));
+      break;
+    case OP_GT:
+      set(I.a, B.CreateICmpUGT(get(I.b), get(I.c)));
+      break;
+    case OP_NOT:
+      set(I.a, B.CreateIsNull(get(I.b)));
+      break;
+    case OP_JMP:
+      B.CreateBr(blocks[I.imm()]);
+      break;
+    case OP_JMPF:
+      B.CreateCondBr(B.CreateIsNull(get(I.a)), blocks[I.imm()],
+                     blocks[pc + 1]);
+      break;
+    case OP_PRINT:
+      B.CreateCall(printType,
+                   address(printType->getPointerTo(), &bytecodePrint),
+                   {get(I.a)});
+      break;
+    case OP_READ:
+      set(I.a, B.CreateCall(readType, address(readType->getPointerTo(),
+                                              &bytecodeRead)));
+      break;
+    case OP_GETSTATIC:
+      set(I.a, B.CreateLoad(i64, address(i64Ptr, statics + I.imm())));
+      break;
+    case OP_PUTSTATIC:
+      B.CreateStore(get(I.a), address(i64Ptr, statics + I.imm()));
+      break;
+    case OP_GETFIELD: {
+      auto object = get(I.b);
+      checkNull(object, pc);
+      set(I.a, B.CreateLoad(i64, field(object, I.c)));
+      break;
+    }
+    case OP_PUTFIELD: {
+      auto object = get(I.a);
+      checkNull(object, pc);
+      B.CreateStore(get(I.c), field(object, I.b));
+      break;
+    }
+    case OP_NEW:
+      set(I.a, B.CreateCall(newType, address(newType->getPointerTo(),
+                                             &bytecodeNew),
+                            {B.getInt32(I.imm())}));
+      break;
+    case OP_INSTANCEOF:
+      set(I.a, B.CreateCall(instanceOfType,
+                            address(instanceOfType->getPointerTo(),
+                                    &bytecodeInstanceOf),
+                            {get(I.b), B.getInt32(I.c)}));
+      break;
+    case OP_CALL:
+    case OP_TAILCALL: {
+      auto receiver = get(I.b);
+      auto parameter = get(I.b + 1);
+      if (I.op == OP_TAILCALL) {
+        jumpBackIfSelf(receiver, parameter, I.c, pc);
+      }
+      auto call = B.CreateCall(
+          callType, address(callType->getPointerTo(), &bytecodeCall),
+          {B.getInt32(index), B.getInt32(pc), receiver, parameter});
+      if (I.op == OP_CALL) {
+        set(I.a, call);
+      } else {
+        call->setTailCall();
+        B.CreateRet(call);
+      }
+      break;
+    }
+    case OP_RET:
+      B.CreateRet(get(I.a));
+      break;
+    }
+  }
+
+  if (verifyFunction(*F, &errs())) {
+    // a translation bug; leave this function to the interpreter
+    return nullptr;
+  }
+  optimizeModule(*M, TM);
+  auto added = jit->addIRModule(
+      orc::ThreadSafeModule(std::move(M), std::move(Context)));
+  if (added) {
+    logAllUnhandledErrors(std::move(added), errs(), "dj2ll: ");
+    return nullptr;
+  }
+  auto symbol = jit->lookup(function.name);
+  if (!symbol) {
+    logAllUnhandledErrors(symbol.takeError(), errs(), "dj2ll: ");
+    return nullptr;
+  }
+  return (NativeFunction)symbol->getAddress();
+}
@@ -0,0 +1,51 @@
+#ifndef BYTECODEJIT_H
+#define BYTECODEJIT_H
+/*--tiered: compiles hot bytecode functions to native code with ORC, one at a
+ * time, on a background thread. the interpreter keeps running meanwhile and
+ * switches to the native code on the next call once it is published*/
+
+#include "bytecode.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace llvm {
+class TargetMachine;
+namespace orc {
+class LLJIT;
+}
+} // namespace llvm
+
+class BytecodeJIT {
+public:
+  // statics is the interpreter's static field array, which compiled code
+  // reads and writes in place. compiled functions are published in natives
+  BytecodeJIT(const BytecodeProgram &program, uint64_t *statics,
+              std::atomic<NativeFunction> *natives);
+  // finishes the function being compiled and drops the rest of the queue
+  ~BytecodeJIT();
+  // queues a function; the first call starts the thread and LLVM
+  void compileLater(size_t function);
+
+private:
+  void work();
+  NativeFunction compile(size_t function);
+
+  const BytecodeProgram &program;
+  uint64_t *statics;
+  std::atomic<NativeFunction> *natives;
+  // only touched by the worker thread
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  llvm::TargetMachine *TM = nullptr;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<size_t> queue;
+  bool stopping = false;
+  std::thread worker;
+};
+
+#endif // __BYTECODEJIT_H_
@@ -43,25 +43,32 @@ int getIndexOfRegularField(std::string desired, int classIndex) {
   return -1;
 }
 
-// class memory is laid out like so for a class that declares N fields and
-// inherits M fields:
+// a class's fields come after all of its superclass's, so that an object can
+// be used wherever one of its superclasses is expected. for a class A that
+// declares a1..aN and a class B extends A that declares b1..bM:
 //
-// 0,1,2,...,N,N+1,...,N+M
-// this pointer,class number , 1th declared , 2nd, ... , Nth declared, 1th
-// inherited,
+// A: a1, ..., aN
+// B: a1, ..., aN, b1, ..., bM
+//
+// codegen.cpp keeps each class's part of the struct in this order, but
+// reorders and packs the fields within a part (see calculateClassStorageNeeds)
 
 int getIndexOfRegularOrInheritedField(std::string ID, int classNum) {
-  // given an ID and a class from which to start, return the index of a field in
-  // that class, offset by 1 for the this pointer, by another 1 for the class
-  // ID, and by the number of variables before it in the inheritance graph
+  // given an ID and a class from which to start, return the position of the
+  // field among all the fields of that class in the order above
   int count = 0;
-  int ind = 0;
   while (count < numClasses && classNum != 0) {
     if (isVarRegularInClass(ID, classNum)) {
-      return ind + getIndexOfRegularField(ID, classNum) + 1 + 1;
+      int ind = getIndexOfRegularField(ID, classNum);
+      int super = classesST[classNum].superclass;
+      for (; count < numClasses && super > 0; count++) {
+        ind += classesST[super].numVars;
+        super = classesST[super].superclass;
+      }
+      return ind;
     }
-    ind += classesST[classNum].numVars;
     classNum = classesST[classNum].superclass;
+    count++;
   }
   return -1;
 }
@@ -0,0 +1,122 @@
+/*
+** codeGenStats.cpp
+**
+** The report is plain text with one row per line and fixed columns, so two
+** builds can be compared with diff. Dispatch branches are the conditional
+** branches and switch cases in the VTable thunks and the ITable: one per
+** (static class, dynamic class, method) triple that survived RTA and the
+** optimizer, and the part of the code that grows fastest with the number of
+** classes.
+*/
+
+#include "codeGenStats.hpp"
+#include "llvm/Object/ObjectFile.h"
+#include <cstdio>
+#include <map>
+
+using namespace llvm;
+
+static std::string groupOf(const Function &F) {
+  auto name = F.getName();
+  if (name.contains("VTable")) {
+    return "VTable thunks";
+  }
+  if (name == "ITable") {
+    return "ITable";
+  }
+  if (name.contains("_method_")) {
+    return "methods";
+  }
+  if (name == "main" || name == "dj_main") {
+    return "main";
+  }
+  return "other";
+}
+
+static bool calls(const Instruction &I, StringRef callee) {
+  auto call = dyn_cast<CallBase>(&I);
+  auto function = call ? call->getCalledFunction() : nullptr;
+  return function && function->getName() == callee;
+}
+
+void printModuleStats(Module &M) {
+  struct Counts {
+    unsigned functions = 0, blocks = 0, instructions = 0;
+  };
+  std::map<std::string, Counts> groups;
+  unsigned dispatchBranches = 0, mallocs = 0, prints = 0;
+  const std::vector<std::string> order = {"VTable thunks", "ITable",
+                                         "methods", "main", "other"};
+  printf("%-40s %8s %12s\n", "function", "blocks", "instructions");
+  for (const auto &group : order) {
+    for (auto &F : M) {
+      if (F.isDeclaration() || groupOf(F) != group) {
+        continue;
+      }
+      unsigned instructions = 0;
+      for (auto &BB : F) {
+        for (auto &I : BB) {
+          instructions++;
+          // every `new` calls dj_alloc, or malloc once dj_alloc is inlined;
+          // the call inside dj_alloc itself does not count
+          mallocs += calls(I, "dj_alloc") ||
+                     (group != "other" && calls(I, "malloc"));
+          prints += calls(I, "dj_print_nat");
+          if (group != "VTable thunks" && group != "ITable") {
+            continue;
+          }
+          if (auto branch = dyn_cast<BranchInst>(&I)) {
+            dispatchBranches += branch->isConditional();
+          } else if (auto switchInst = dyn_cast<SwitchInst>(&I)) {
+            dispatchBranches += switchInst->getNumCases();
+          }
+        }
+      }
+      printf("%-40s %8zu %12u\n", F.getName().str().c_str(), F.size(),
+             instructions);
+      groups[group].functions++;
+      groups[group].blocks += F.size();
+      groups[group].instructions += instructions;
+    }
+  }
+  printf("\n");
+  Counts total;
+  for (const auto &group : order) {
+    const auto &counts = groups[group];
+    auto label = group + " (" + std::to_string(counts.functions) + ")";
+    printf("%-40s %8u %12u\n", label.c_str(), counts.blocks,
+           counts.instructions);
+    total.blocks += counts.blocks;
+    total.instructions += counts.instructions;
+  }
+  printf("%-40s %8u %12u\n", "total", total.blocks, total.instructions);
+  printf("\n%-40s %8u\n", "dispatch branches", dispatchBranches);
+  printf("%-40s %8u\n", "malloc calls", mallocs);
+  printf("%-40s %8u\n", "printNat calls", prints);
+}
+
+void printObjectStats(const std::vector<std::string> &objects) {
+  std::map<std::string, uint64_t> sections;
+  for (const auto &path : objects) {
+    auto object = object::ObjectFile::createObjectFile(path);
+    if (!object) {
+      logAllUnhandledErrors(object.takeError(), errs(), "dj2ll: ");
+      continue;
+    }
+    for (const auto &section : object->getBinary()->sections()) {
+      auto name = section.getName();
+      if (!name) {
+        consumeError(name.takeError());
+        continue;
+      }
+      if (section.getSize() != 0) {
+        sections[name->str()] += section.getSize();
+      }
+    }
+  }
+  printf("\n%-40s %8s\n", "section", "bytes");
+  for (const auto &section : sections) {
+    printf("%-40s %8llu\n", section.first.c_str(),
+           (unsigned long long)section.second);
+  }
+}
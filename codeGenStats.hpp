@@ -0,0 +1,17 @@
+#ifndef CODEGENSTATS_H
+#define CODEGENSTATS_H
+/*--stats: a size report for the generated code. per function: basic blocks
+ * and instructions, grouped into the VTable thunks, the ITable, the methods
+ * and main; the number of dispatch branches, malloc calls and printNat calls;
+ * and the size of every section of the object files*/
+
+#include "llvm_includes.hpp"
+#include <string>
+#include <vector>
+
+void printModuleStats(llvm::Module &M);
+
+// the sizes of sections with the same name are added up across objects
+void printObjectStats(const std::vector<std::string> &objects);
+
+#endif // __CODEGENSTATS_H_
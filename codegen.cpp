@@ -24,10 +24,18 @@
 
 #include "codegen.hpp"
 #include "codeGenClass.hpp"
+#include "codeGenStats.hpp"
+#include "incrementalBuild.hpp"
 #include "llast.hpp"
 #include "llvm_includes.hpp"
+#include "optRemarks.hpp"
+#include "runtime.h"
+#include "runtimeLink.hpp"
+#include "sourceInput.hpp"
 #include "translateAST.hpp"
 #include "util.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <algorithm>
 #include <cassert>
 #include <cctype>
@@ -37,6 +45,7 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <set>
 #include <stack>
 #include <string>
 #include <system_error>
@@ -45,10 +54,322 @@
 
 using namespace llvm;
 extern std::string inputFile;
+extern std::vector<std::string> cachedObjects;
 
 static std::map<std::string, llvm::StructType *> allocatedClasses;
 static std::map<std::string, std::vector<llvm::Type *>> classSizes;
+// where each field of each class lives in the class's struct: the element,
+// and for a bool the bit of that element that holds it. the fields a class
+// inherits are where they are in the superclass
+struct FieldLocation {
+  unsigned element;
+  int bit; // -1 when the element is the field itself
+};
+static std::map<int, std::map<std::string, FieldLocation>> fieldLocations;
 static std::unique_ptr<llvm::Module> TheModule;
+// copied from DJProgram::promptOnRead so DJRead::codeGen can see it
+static bool emitReadPrompt = true;
+// the results of rapidTypeAnalysis, copied from the DJProgram being compiled
+static bool pruneDeadCode = false;
+static std::set<int> liveClasses;
+static std::set<std::pair<int, int>> liveMethods;
+// copied from DJProgram::nullChecks
+static bool checkNulls = false;
+static bool countAllocations = false;
+static bool traceCalls = false;
+
+// the block that self-recursive tail calls in the current method jump to, or
+// nullptr when the method has none
+static BasicBlock *TailRecurseBB = nullptr;
+
+// the frame planner. every alloca goes at the top of its function's entry
+// block, where mem2reg can promote it and where it is allocated once per call
+// rather than once per execution. a temporary borrows a slot for as long as
+// its expression needs it, bracketed by lifetime markers, and then returns it
+// so that the next temporary of the same type reuses it
+static std::map<Function *, std::map<Type *, std::vector<AllocaInst *>>>
+    freeSlots;
+
+static AllocaInst *createEntryBlockAlloca(Function *F, Type *T,
+                                          const std::string &name) {
+  IRBuilder<> EntryBuilder(&F->getEntryBlock(), F->getEntryBlock().begin());
+  return EntryBuilder.CreateAlloca(T, nullptr, name);
+}
+
+static ConstantInt *slotSize(AllocaInst *slot) {
+  return Builder.getInt64(
+      TheModule->getDataLayout().getTypeAllocSize(slot->getAllocatedType()));
+}
+
+static AllocaInst *borrowSlot(Type *T, const std::string &name) {
+  Function *F = Builder.GetInsertBlock()->getParent();
+  auto &free = freeSlots[F][T];
+  AllocaInst *slot;
+  if (free.empty()) {
+    slot = createEntryBlockAlloca(F, T, name);
+  } else {
+    slot = free.back();
+    free.pop_back();
+  }
+  Builder.CreateLifetimeStart(slot, slotSize(slot));
+  return slot;
+}
+
+static void returnSlot(AllocaInst *slot) {
+  Builder.CreateLifetimeEnd(slot, slotSize(slot));
+  freeSlots[slot->getFunction()][slot->getAllocatedType()].push_back(slot);
+}
+
+static bool classIsLive(int classNum) {
+  return !pruneDeadCode || liveClasses.count(classNum);
+}
+
+static bool methodIsLive(int classNum, int methodNum) {
+  return !pruneDeadCode || liveMethods.count({classNum, methodNum});
+}
+
+static std::string djNameOf(Function &F) {
+  // C_method_foo is printed as C.foo; thunks and main keep their own names
+  auto name = F.getName().str();
+  if (name == "dj_main") {
+    return "main";
+  }
+  auto split = name.find("_method_");
+  if (split == std::string::npos) {
+    return name;
+  }
+  return name.substr(0, split) + "." + name.substr(split + 8);
+}
+
+// --trace: the number of every traced function, by LLVM name, which is its
+// index in the name table main hands to dj_enable_tracing. main is 0
+static std::map<std::string, unsigned int> traceIDs;
+static std::vector<std::string> traceNames;
+
+static void emitTraceEvent(const std::string &function, unsigned int kind) {
+  if (!traceCalls) {
+    return;
+  }
+  Builder.CreateCall(TheModule->getFunction("dj_trace"),
+                     {Builder.getInt32(traceIDs[function] << 2 | kind)});
+}
+
+static void placeTraceEnd(const std::string &function, Value *result,
+                          BasicBlock *block, std::set<Value *> &placed) {
+  // put the END event on the path that produces result through block: in
+  // front of it if it is a tail call, so that the call stays in tail
+  // position, and otherwise at the end of the block
+  result = result->stripPointerCasts();
+  auto Call = dyn_cast<CallInst>(result);
+  if (Call && Call->isTailCall()) {
+    if (placed.insert(Call).second) {
+      Builder.SetInsertPoint(Call);
+      emitTraceEvent(function, DJ_TRACE_END);
+    }
+    return;
+  }
+  // the merge of an if: every incoming block runs only on its own path
+  auto Phi = dyn_cast<PHINode>(result);
+  bool ownPaths = Phi != nullptr;
+  for (unsigned i = 0; ownPaths && i < Phi->getNumIncomingValues(); i++) {
+    auto Br = dyn_cast<BranchInst>(Phi->getIncomingBlock(i)->getTerminator());
+    ownPaths = Br != nullptr && Br->isUnconditional();
+  }
+  if (ownPaths) {
+    for (unsigned i = 0; i < Phi->getNumIncomingValues(); i++) {
+      placeTraceEnd(function, Phi->getIncomingValue(i),
+                    Phi->getIncomingBlock(i), placed);
+    }
+    return;
+  }
+  if (block->getTerminator()) {
+    Builder.SetInsertPoint(block->getTerminator());
+  } else {
+    Builder.SetInsertPoint(block);
+  }
+  emitTraceEvent(function, DJ_TRACE_END);
+}
+
+static void emitTraceEnd(const std::string &function, Value *result) {
+  // the END event of a method that is about to return result. a call in tail
+  // position ends the method before it starts, so the event goes in front
+  // of each one; after the call, it would keep the call from being a tail
+  // call, and mutual recursion would grow the stack again under --trace
+  if (!traceCalls) {
+    return;
+  }
+  auto ReturnBB = Builder.GetInsertBlock();
+  std::set<Value *> placed;
+  placeTraceEnd(function, result, ReturnBB, placed);
+  Builder.SetInsertPoint(ReturnBB);
+}
+
+// the name string each function's null checks report
+static std::map<Function *, Constant *> nullReportNames;
+
+static void emitNullBranch(Value *object, unsigned line, bool implicit) {
+  // branch to a call to dj_null_deref when object is null. with implicit, the
+  // branch carries !make.implicit, so the backend deletes it and lets the
+  // load or store that follows it fault instead; the fault map it emits tells
+  // the runtime where that instruction's null handler is
+  Function *TheFunction = Builder.GetInsertBlock()->getParent();
+  BasicBlock *NullBB = BasicBlock::Create(TheContext, "isnull", TheFunction);
+  BasicBlock *NotNullBB =
+      BasicBlock::Create(TheContext, "notnull", TheFunction);
+  auto Br =
+      Builder.CreateCondBr(Builder.CreateIsNull(object), NullBB, NotNullBB);
+  if (implicit) {
+    Br->setMetadata(LLVMContext::MD_make_implicit,
+                    MDNode::get(TheContext, {}));
+  }
+  Builder.SetInsertPoint(NullBB);
+  if (!nullReportNames.count(TheFunction)) {
+    nullReportNames[TheFunction] =
+        Builder.CreateGlobalStringPtr(djNameOf(*TheFunction), "methodname");
+  }
+  auto reportedLine = Builder.getInt32(sourceLine(line).second);
+  Builder.CreateCall(TheModule->getFunction("dj_null_deref"),
+                     {reportedLine, nullReportNames[TheFunction]});
+  Builder.CreateUnreachable();
+  Builder.SetInsertPoint(NotNullBB);
+}
+
+static void emitNullCheck(Value *object, unsigned line) {
+  // --null-checks: nothing runs on the non-null path
+  if (checkNulls) {
+    emitNullBranch(object, line, true);
+  }
+}
+
+// -g: the DIBuilder for TheModule, and the subprogram of the method (or main)
+// being generated. DebugScope is nullptr while generating the VTables, the
+// ITable and everything else that has no DJ source
+static bool emitDebugInfo = false;
+// --opt-remarks without -g: only what the remarks need, i.e. the subprograms
+// and the line table
+static bool debugLinesOnly = false;
+static std::unique_ptr<DIBuilder> DBuilder;
+static DICompileUnit *DebugUnit = nullptr;
+static DISubprogram *DebugScope = nullptr;
+static std::map<int, DIType *> debugTypes;
+static std::map<std::string, DIFile *> debugFiles;
+
+static DIFile *debugFile(const std::string &path) {
+  if (!debugFiles.count(path)) {
+    SmallString<256> source(path);
+    sys::fs::make_absolute(source);
+    debugFiles[path] = DBuilder->createFile(sys::path::filename(source),
+                                            sys::path::parent_path(source));
+  }
+  return debugFiles[path];
+}
+
+static void beginDebugInfo(bool optimized) {
+  DBuilder = std::make_unique<DIBuilder>(*TheModule);
+  debugFiles.clear();
+  debugTypes.clear();
+  DebugUnit = DBuilder->createCompileUnit(
+      dwarf::DW_LANG_Java, debugFile(inputFile + ".dj"), "dj2ll", optimized,
+      "", 0, "",
+      debugLinesOnly ? DICompileUnit::LineTablesOnly
+                     : DICompileUnit::FullDebug);
+  TheModule->addModuleFlag(Module::Warning, "Debug Info Version",
+                           DEBUG_METADATA_VERSION);
+  TheModule->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+}
+
+static DIType *debugType(int djType) {
+  // objects are pointers to structs the debugger only knows by name
+  if (!debugTypes.count(djType)) {
+    if (djType == TYPE_NAT) {
+      debugTypes[djType] =
+          DBuilder->createBasicType("nat", 32, dwarf::DW_ATE_unsigned);
+    } else if (djType == TYPE_BOOL) {
+      debugTypes[djType] =
+          DBuilder->createBasicType("bool", 8, dwarf::DW_ATE_boolean);
+    } else {
+      auto declared = sourceLine(classesST[djType].classNameLineNumber);
+      auto Class = DBuilder->createForwardDecl(
+          dwarf::DW_TAG_structure_type, typeString(djType), DebugUnit,
+          debugFile(declared.first), declared.second);
+      debugTypes[djType] = DBuilder->createPointerType(
+          Class, TheModule->getDataLayout().getPointerSizeInBits());
+    }
+  }
+  return debugTypes[djType];
+}
+
+static void beginDebugFunction(Function *F, std::string name, unsigned line,
+                               std::vector<int> signature) {
+  // signature is the return type followed by the parameter types
+  if (!emitDebugInfo) {
+    return;
+  }
+  std::vector<Metadata *> types;
+  for (auto t : signature) {
+    types.push_back(debugType(t));
+  }
+  // a method lies entirely within one of the program's files
+  auto declared = sourceLine(line);
+  DebugScope = DBuilder->createFunction(
+      DebugUnit, name, F->getName(), debugFile(declared.first),
+      declared.second,
+      DBuilder->createSubroutineType(DBuilder->getOrCreateTypeArray(types)),
+      declared.second, DINode::FlagPrototyped,
+      DISubprogram::SPFlagDefinition);
+  F->setSubprogram(DebugScope);
+  Builder.SetCurrentDebugLocation(
+      DILocation::get(TheContext, declared.second, 0, DebugScope));
+}
+
+static void endDebugFunction() {
+  DebugScope = nullptr;
+  Builder.SetCurrentDebugLocation(DebugLoc());
+}
+
+static void setDebugLine(unsigned line) {
+  // everything generated from here on belongs to this source line
+  if (DebugScope != nullptr && line != 0) {
+    Builder.SetCurrentDebugLocation(DILocation::get(
+        TheContext, sourceLine(line).second, 0, DebugScope));
+  }
+}
+
+static void declareDebugVariable(AllocaInst *storage, std::string name,
+                                 int djType, unsigned line, unsigned argNo) {
+  // argNo is 1 for `this` and 2 for the parameter; locals pass 0
+  if (DebugScope == nullptr || debugLinesOnly) {
+    return;
+  }
+  line = sourceLine(line).second;
+  DILocalVariable *variable;
+  if (argNo != 0) {
+    variable = DBuilder->createParameterVariable(
+        DebugScope, name, argNo, DebugScope->getFile(), line,
+        debugType(djType), true);
+  } else {
+    variable = DBuilder->createAutoVariable(DebugScope, name,
+                                            DebugScope->getFile(), line,
+                                            debugType(djType), true);
+  }
+  DBuilder->insertDeclare(storage, variable, DBuilder->createExpression(),
+                          DILocation::get(TheContext, line, 0, DebugScope),
+                          Builder.GetInsertBlock());
+}
+
+static void finishDebugInfo() {
+  DBuilder->finalize();
+  if (debugLinesOnly) {
+    // leave the code exactly as it is without debug info
+    return;
+  }
+  // sampling profilers walk the stack through the frame pointer
+  for (auto &F : *TheModule) {
+    if (!F.isDeclaration()) {
+      F.addFnAttr("frame-pointer", "all");
+    }
+  }
+}
 
 Type *getLLVMTypeFromDJType(std::string djType) {
   if (djType == "bool") {
@@ -67,11 +388,44 @@ Type *getLLVMTypeFromDJType(int djType) {
 std::vector<Value *> getGEPIndex(std::string variable, int classID) {
   std::vector<Value *> ret = {
       ConstantInt::get(TheContext, APInt(32, 0)),
-      ConstantInt::get(TheContext, APInt(32, getIndexOfRegularOrInheritedField(
-                                                 variable, classID)))};
+      ConstantInt::get(TheContext,
+                       APInt(32, fieldLocations[classID][variable].element))};
   return ret;
 }
 
+static Value *loadField(Value *object, std::string ID, int classID) {
+  // object points to a classID (or a subclass); bools are unpacked from
+  // their bitfield word
+  auto location = fieldLocations[classID][ID];
+  Value *field =
+      Builder.CreateLoad(Builder.CreateGEP(object, getGEPIndex(ID, classID)));
+  if (location.bit < 0) {
+    return field;
+  }
+  return Builder.CreateTrunc(Builder.CreateLShr(field, location.bit),
+                             Builder.getInt1Ty());
+}
+
+static void storeField(Value *object, std::string ID, int classID,
+                       Value *value) {
+  auto location = fieldLocations[classID][ID];
+  auto address = Builder.CreateGEP(object, getGEPIndex(ID, classID));
+  auto fieldType = address->getType()->getPointerElementType();
+  if (location.bit >= 0) {
+    // read-modify-write the bitfield word
+    auto word = Builder.CreateLoad(address);
+    auto others = Builder.CreateAnd(
+        word, ~APInt::getOneBitSet(fieldType->getIntegerBitWidth(),
+                                   location.bit));
+    value = Builder.CreateOr(
+        others, Builder.CreateShl(Builder.CreateZExt(value, fieldType),
+                                  location.bit));
+  } else if (value->getType()->isPointerTy()) {
+    value = Builder.CreatePointerCast(value, fieldType);
+  }
+  Builder.CreateStore(value, address);
+}
+
 std::vector<Value *> getThisIndex() {
   // return the index in a struct of its `this` pointer
   std::vector<Value *> ret = {ConstantInt::get(TheContext, APInt(32, 0)),
@@ -86,47 +440,105 @@ std::vector<Value *> getGEPID() {
   return ret;
 }
 
-std::vector<Type *> calculateInheritedStorageNeeds(
-    int classNum, std::map<std::string, llvm::StructType *> &allocatedClasses) {
-  // given a class ID, iterate inclusively from that class through all its
-  // superclasses, adding LLVM types to its declaration
-  int count = 0;
+static void
+layOutClass(int classNum,
+            std::map<std::string, std::vector<llvm::Type *>> &layouts,
+            std::map<int, uint64_t> &sizes) {
+  // a class's struct is its superclass's struct followed by the fields the
+  // class declares. its bools share bitfield words of up to 32 bits, and
+  // the non-bool fields and those words are placed one at a time, always
+  // the one that needs the least padding next
+  auto classST = classesST[classNum];
+  if (layouts.count(classST.className)) {
+    return;
+  }
+  const auto &DL = TheModule->getDataLayout();
   std::vector<Type *> members;
-  while (count < numClasses && classNum != 0 && classNum != -4) {
-    auto classST = classesST[classNum];
-    auto varST = classST.varList;
-    for (int j = 0; j < classST.numVars; j++) {
-      members.push_back(getLLVMTypeFromDJType(varST[j].type));
+  uint64_t offset = 0;
+  auto place = [&](Type *T) {
+    offset = alignTo(offset, DL.getABITypeAlignment(T)) +
+             DL.getTypeAllocSize(T);
+    members.push_back(T);
+  };
+  int super = classST.superclass;
+  if (classNum == 0 || super < 0) {
+    place(getLLVMTypeFromDJType(classST.className)); //`this` pointer
+    place(getLLVMTypeFromDJType("nat"));             // just an int for class ID
+  } else {
+    layOutClass(super, layouts, sizes);
+    members = layouts[typeString(super)];
+    members[0] = getLLVMTypeFromDJType(classST.className);
+    offset = sizes[super];
+    fieldLocations[classNum] = fieldLocations[super];
+  }
+
+  // the fields to place: each is one element of the struct
+  struct Item {
+    Type *type;
+    std::vector<std::pair<std::string, int>> fields; // name and bit
+  };
+  std::vector<Item> items;
+  std::vector<std::string> bools;
+  for (int j = 0; j < classST.numVars; j++) {
+    if (classST.varList[j].type == TYPE_BOOL) {
+      bools.push_back(classST.varList[j].varName);
+    } else {
+      items.push_back({getLLVMTypeFromDJType(classST.varList[j].type),
+                       {{classST.varList[j].varName, -1}}});
     }
-    classNum = classesST[classNum].superclass;
   }
-  return members;
+  for (size_t i = 0; i < bools.size(); i += 32) {
+    auto count = std::min<size_t>(32, bools.size() - i);
+    Item word = {Type::getIntNTy(TheContext, count <= 8    ? 8
+                                             : count <= 16 ? 16
+                                                           : 32),
+                 {}};
+    for (size_t bit = 0; bit < count; bit++) {
+      word.fields.push_back({bools[i + bit], (int)bit});
+    }
+    items.push_back(word);
+  }
+  while (!items.empty()) {
+    // the item that needs the least padding here, and of those the most
+    // aligned. ties go to the earlier item: the non-bool fields come first,
+    // in declaration order, then the bool words, so a bool word goes ahead
+    // of a non-bool field only when that field needs more padding or is
+    // less aligned (a nat at an odd offset, or an object at offset 4 mod 8)
+    auto best = items.begin();
+    for (auto item = items.begin(); item != items.end(); item++) {
+      auto align = DL.getABITypeAlignment(item->type);
+      auto bestAlign = DL.getABITypeAlignment(best->type);
+      auto padding = alignTo(offset, align) - offset;
+      auto bestPadding = alignTo(offset, bestAlign) - offset;
+      if (padding < bestPadding ||
+          (padding == bestPadding && align > bestAlign)) {
+        best = item;
+      }
+    }
+    for (const auto &field : best->fields) {
+      fieldLocations[classNum][field.first] = {(unsigned)members.size(),
+                                               field.second};
+    }
+    place(best->type);
+    items.erase(best);
+  }
+  layouts[classST.className] = members;
+  sizes[classNum] = offset;
 }
 
 std::map<std::string, std::vector<llvm::Type *>> calculateClassStorageNeeds(
     std::map<std::string, llvm::StructType *> &allocatedClasses) {
   // determine the storage needs of every class declared by the program
   std::map<std::string, std::vector<llvm::Type *>> ret;
-  std::vector<llvm::Type *> members;
-  symbolTable genericST;
+  std::map<int, uint64_t> sizes;
+  fieldLocations.clear();
   for (int i = 0; i < numClasses; i++) {
-    auto classST = classesST[i];
-    auto varST = classST.varList;
-    members = {
-        getLLVMTypeFromDJType(classST.className), //`this` pointer
-        getLLVMTypeFromDJType("nat")              // just an int for class ID
-    };
-    for (int j = 0; j < classST.numVars; j++) {
-      genericST[varST[j].varName] = nullptr;
-      members.push_back(getLLVMTypeFromDJType(varST[j].type));
+    layOutClass(i, ret, sizes);
+    symbolTable genericST;
+    for (int j = 0; j < classesST[i].numVars; j++) {
+      genericST[classesST[i].varList[j].varName] = nullptr;
     }
-    auto inherited =
-        calculateInheritedStorageNeeds(classST.superclass, allocatedClasses);
-    members.insert(members.end(), inherited.begin(), inherited.end());
-    ret[classST.className] = members;
-    NamedValues[classST.className] = genericST;
-    members.clear();
-    genericST.clear();
+    NamedValues[classesST[i].className] = genericST;
   }
   return ret;
 }
@@ -219,6 +631,11 @@ void emitVTable() {
       getLLVMTypeFromDJType("nat"), // just an int; static caller type
       getLLVMTypeFromDJType("nat"), // just an int; static method number
       getLLVMTypeFromDJType(0)};    // placeholder for original parameter
+  if (checkNulls) {
+    // the caller loads the dynamic class itself, right after its implicit
+    // null check, and passes it along
+    functionArgs.push_back(getLLVMTypeFromDJType("nat"));
+  }
   llvm::FunctionType *VTableType;
   Function *VTableFunc;
   for (const std::string &returnType : {"nat", "bool", "Object"}) {
@@ -238,7 +655,8 @@ void emitVTable() {
         for (int j = 1; j < numClasses; j++) {                // dynamic class
           for (int k = 0; k < classesST[i].numMethods; k++) { // static method
             auto MST = classesST[i].methodList[k];
-            if (isSubtype(j, i)) {
+            // skip dynamic classes the program never instantiates
+            if (isSubtype(j, i) && classIsLive(j)) {
               // we can check MST instead of DMST here because subclasses that
               // override their parents' classes methods are guaranteed to have
               // the same return type and parameter.
@@ -246,6 +664,10 @@ void emitVTable() {
                                           returnType, paramType)) {
                 // get Dynamic Class and Dynamic Method IDs
                 const auto &[DC, DM] = getDynamicMethodInfo(i, j, k);
+                if (!methodIsLive(DC, DM)) {
+                  // no reachable call site dispatches here
+                  continue;
+                }
                 // dynamic method symbol table
                 auto DMST = classesST[DC].methodList[DM];
                 if (DMST.paramType >= OBJECT_TYPE) {
@@ -261,8 +683,13 @@ void emitVTable() {
                     dynamicClassName + "_method_" + dynamicMethodName;
                 std::vector<Value *> actualArgs = {originalThis, originalParam};
 
-                auto incomingDynamicType = Builder.CreateLoad(
-                    Builder.CreateGEP(originalThis, getGEPID()));
+                Value *incomingDynamicType;
+                if (checkNulls) {
+                  incomingDynamicType = VTableFunc->getArg(4);
+                } else {
+                  incomingDynamicType = Builder.CreateLoad(
+                      Builder.CreateGEP(originalThis, getGEPID()));
+                }
 
                 // check for static class and dynamic class
                 auto condValue = Builder.CreateAnd(
@@ -287,10 +714,14 @@ void emitVTable() {
                 // emit then value
                 Builder.SetInsertPoint(ThenBB);
 
+                emitTraceEvent(actualMethodName, DJ_TRACE_DISPATCH);
                 // emit call to a variable so we can cast it if necessary
                 // (remember, all the struct vtables are returning Object)
-                Value *ret = Builder.CreateCall(
+                CallInst *call = Builder.CreateCall(
                     TheModule->getFunction(actualMethodName), actualArgs);
+                // nothing but a return follows, so let the backend jump
+                call->setTailCall();
+                Value *ret = call;
                 if (returnType == "Object") {
                   ret = Builder.CreatePointerCast(
                       ret, getLLVMTypeFromDJType("Object"));
@@ -312,7 +743,7 @@ void emitVTable() {
   }
 }
 
-void generateMethodST(int classNum, int methodNum) {
+void generateMethodST(int classNum, int methodNum, bool loopsOnTailCalls) {
   // generate symbol tables of LLVM types from the old symbol tables generated
   // in symbtbl.c for the requested method.
 
@@ -322,42 +753,433 @@ void generateMethodST(int classNum, int methodNum) {
   MethodDecl method = classDecl.methodList[methodNum];
   auto methodName = className + "_method_" + method.methodName;
   Function *LLMethod = TheModule->getFunction(methodName);
-  genericSymbolTable["this"] =
-      Builder.CreateAlloca(LLMethod->getArg(0)->getType(), nullptr, "this");
+  genericSymbolTable["this"] = createEntryBlockAlloca(
+      LLMethod, LLMethod->getArg(0)->getType(), "this");
   Builder.CreateStore(LLMethod->getArg(0), genericSymbolTable["this"]);
   // set parameter value to whatever is passed in
-  genericSymbolTable[method.paramName] = Builder.CreateAlloca(
-      LLMethod->getArg(1)->getType(), nullptr, method.paramName);
+  genericSymbolTable[method.paramName] = createEntryBlockAlloca(
+      LLMethod, LLMethod->getArg(1)->getType(), method.paramName);
   Builder.CreateStore(LLMethod->getArg(1),
                       genericSymbolTable[method.paramName]);
   for (int i = 0; i < method.numLocals; i++) {
     auto var = method.localST[i];
     auto name = var.varName;
     auto LLType = getLLVMTypeFromDJType(var.type);
-    genericSymbolTable[name] = Builder.CreateAlloca(LLType, nullptr, name);
-    Builder.CreateStore(Constant::getNullValue(LLType),
-                        genericSymbolTable[name]);
+    genericSymbolTable[name] = createEntryBlockAlloca(LLMethod, LLType, name);
+  }
+  declareDebugVariable(genericSymbolTable["this"], "this", classNum,
+                       method.methodNameLineNumber, 1);
+  declareDebugVariable(genericSymbolTable[method.paramName], method.paramName,
+                       method.paramType, method.paramNameLineNumber, 2);
+  for (int i = 0; i < method.numLocals; i++) {
+    auto var = method.localST[i];
+    declareDebugVariable(genericSymbolTable[var.varName], var.varName,
+                         var.type, var.varNameLineNumber, 0);
+  }
+  TailRecurseBB = nullptr;
+  if (loopsOnTailCalls) {
+    // self-recursive tail calls store the new `this` and parameter and jump
+    // here, so the locals are zeroed again exactly as a fresh call would
+    TailRecurseBB = createBB(LLMethod, "tailrecurse");
+    Builder.CreateBr(TailRecurseBB);
+    Builder.SetInsertPoint(TailRecurseBB);
+  }
+  for (int i = 0; i < method.numLocals; i++) {
+    auto name = method.localST[i].varName;
+    Builder.CreateStore(
+        Constant::getNullValue(genericSymbolTable[name]->getAllocatedType()),
+        genericSymbolTable[name]);
   }
   NamedValues[methodName] = genericSymbolTable;
 }
 
-Function *DJProgram::codeGen(symbolTable ST, int type) {
-  TheModule = std::make_unique<Module>(inputFile, TheContext);
+static Reloc::Model parseRelocationModel(const std::string &name) {
+  if (name == "" || name == "dynamic-no-pic") {
+    return Reloc::Model::DynamicNoPIC;
+  } else if (name == "static") {
+    return Reloc::Model::Static;
+  } else if (name == "pic") {
+    return Reloc::Model::PIC_;
+  }
+  errs() << "ERROR: unknown relocation model " << name
+         << " (expected static, pic or dynamic-no-pic)\n";
+  exit(-1);
+}
+
+static Optional<CodeModel::Model> parseCodeModel(const std::string &name) {
+  if (name == "") {
+    return None;
+  } else if (name == "small") {
+    return CodeModel::Small;
+  } else if (name == "kernel") {
+    return CodeModel::Kernel;
+  } else if (name == "medium") {
+    return CodeModel::Medium;
+  } else if (name == "large") {
+    return CodeModel::Large;
+  }
+  errs() << "ERROR: unknown code model " << name
+         << " (expected small, kernel, medium or large)\n";
+  exit(-1);
+}
+
+static std::string hostFeatures() {
+  StringMap<bool> HostFeatures;
+  if (!sys::getHostCPUFeatures(HostFeatures)) {
+    std::cerr << LRED "Could not determine host CPU features.\n";
+    return "";
+  }
+  SubtargetFeatures TheFeatures;
+  for (auto i : HostFeatures.keys()) {
+    if (HostFeatures[i]) {
+      TheFeatures.AddFeature(i.str());
+    }
+  }
+  return TheFeatures.getString();
+}
+
+TargetMachine *createTargetMachine(const TargetSelection &selection) {
+  /*copied mostly verbatim from the kaleidoscope tutorial*/
+  // built once per process and selection; `dj2ll --server` builds the host
+  // one before forking off compiles so that none of them pay for it
+  static std::map<std::string, TargetMachine *> TargetMachines;
+  auto key = selection.triple + "|" + selection.cpu + "|" +
+             selection.features + "|" + selection.relocationModel + "|" +
+             selection.codeModel +
+             (selection.functionSections ? "|sections" : "");
+  if (TargetMachines.count(key)) {
+    return TargetMachines[key];
+  }
+  auto TargetTriple = selection.triple.empty()
+                          ? sys::getDefaultTargetTriple()
+                          : Triple::normalize(selection.triple);
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  InitializeAllAsmParsers();
+  InitializeAllAsmPrinters();
+  std::string Error;
+  auto Target = TargetRegistry::lookupTarget(TargetTriple, Error);
+  // Print an error and exit if we couldn't find the requested target.
+  // This generally occurs if we've forgotten to initialise the
+  // TargetRegistry or we have a bogus target triple.
+  if (!Target) {
+    errs() << Error;
+    exit(-1);
+  }
+  // without --target or --mcpu, tune for and use everything the build
+  // machine has. naming either one means the binary is going somewhere else,
+  // so only the features asked for with --mattr are added
+  bool native = selection.cpu == "native" ||
+                (selection.cpu.empty() && selection.triple.empty());
+  std::string CPU = native ? sys::getHostCPUName().str() : selection.cpu;
+  std::string Features = native ? hostFeatures() : "";
+  if (!selection.features.empty()) {
+    // later entries win, so --mattr=-avx512f can turn off a host feature
+    Features += (Features.empty() ? "" : ",") + selection.features;
+  }
+
+  TargetOptions opt;
+  opt.FunctionSections = selection.functionSections;
+  opt.DataSections = selection.functionSections;
+  auto RM = parseRelocationModel(selection.relocationModel);
+  auto CM = parseCodeModel(selection.codeModel);
+  auto TM =
+      Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM, CM);
+  if (!CPU.empty() && !TM->getMCSubtargetInfo()->isCPUStringValid(CPU)) {
+    errs() << "ERROR: " << CPU << " is not a CPU that " << TargetTriple
+           << " knows about\n";
+    exit(-1);
+  }
+  TargetMachines[key] = TM;
+  return TM;
+}
+
+void optimizeModule(Module &M, TargetMachine *TM) {
+  // Create a new pass manager attached to it.
+  TheFPM = std::make_unique<legacy::FunctionPassManager>(&M);
+  // Let the loop passes ask the target about vector widths and costs.
+  TheFPM->add(createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+  // Promote allocas to registers.
+  TheFPM->add(createPromoteMemoryToRegisterPass());
+  // Do simple "peephole" optimizations and bit-twiddling optzns.
+  TheFPM->add(createInstructionCombiningPass());
+  // Reassociate expressions.
+  TheFPM->add(createReassociatePass());
+  // Eliminate Common SubExpressions.
+  TheFPM->add(createGVNPass());
+  // Simplify the control flow graph (deleting unreachable blocks, etc).
+  TheFPM->add(createCFGSimplificationPass());
+  // DJFor::codeGen emits top-tested loops with a single latch; give them
+  // preheaders and dedicated exits, then rotate them into bottom-tested form.
+  TheFPM->add(createLoopSimplifyPass());
+  TheFPM->add(createLoopRotatePass());
+  // Hoist loop-invariant loads and arithmetic into the preheader.
+  TheFPM->add(createLICMPass());
+  // Canonicalize induction variables and compute trip counts.
+  TheFPM->add(createIndVarSimplifyPass());
+  // Vectorize, then unroll what is left.
+  TheFPM->add(createLoopVectorizePass());
+  TheFPM->add(createLoopUnrollPass());
+  // Clean up after the loop passes.
+  TheFPM->add(createInstructionCombiningPass());
+  TheFPM->add(createCFGSimplificationPass());
+  TheFPM->doInitialization();
+  for (auto &F : M) {
+    if (!F.isDeclaration()) {
+      TheFPM->run(F);
+    }
+  }
+  TheFPM->doFinalization();
+}
+
+static void emitFile(Module &M, TargetMachine *TM, std::string Filename,
+                     CodeGenFileType FileType) {
+  std::error_code EC;
+  raw_fd_ostream dest(Filename, EC, sys::fs::OF_None);
+
+  if (EC) {
+    errs() << "Could not open file: " << EC.message();
+    exit(-1);
+  }
+  legacy::PassManager pass;
+
+  if (TM->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
+    errs() << "TargetMachine can't emit a file of this type";
+    exit(-1);
+  }
 
-  if (hasPrintNat || hasReadNat) {
-    std::vector<Type *> args;
-    args.push_back(Type::getInt8PtrTy(TheContext));
-    FunctionType *IOType = FunctionType::get(Builder.getInt32Ty(), args, true);
-    if (hasPrintNat) {
-      // emit runtime function `printNat()`, which is just system printf
-      Function::Create(IOType, Function::ExternalLinkage, "printf",
-                       TheModule.get());
+  pass.run(M);
+  dest.flush();
+}
+
+void emitObjectFile(Module &M, TargetMachine *TM, std::string Filename) {
+  emitFile(M, TM, Filename, CGFT_ObjectFile);
+}
+
+// --save-temps: <dir>/<program><suffix>
+static std::string tempPath(const std::string &dir, const std::string &suffix) {
+  return dir + "/" + sys::path::filename(inputFile).str() + suffix;
+}
+
+static void saveIR(Module &M, const std::string &path, bool bitcode) {
+  std::error_code EC;
+  raw_fd_ostream out(path, EC, bitcode ? sys::fs::OF_None : sys::fs::OF_Text);
+  if (EC) {
+    printf("ERROR: cannot write %s: %s\n", path.c_str(),
+           EC.message().c_str());
+    exit(-1);
+  }
+  if (bitcode) {
+    WriteBitcodeToFile(M, out);
+  } else {
+    M.print(out, nullptr);
+  }
+}
+
+void internalizeModule(Module &M) {
+  // a DJ program is a closed world: nothing outside this module calls into it
+  // except through `main`. give everything else internal linkage so the
+  // interprocedural passes may rewrite or delete it, and switch the calling
+  // convention to fastcc wherever every call site is visible to us
+  for (auto &F : M) {
+    if (F.isDeclaration() || F.getName() == "main") {
+      continue;
+    }
+    F.setLinkage(GlobalValue::InternalLinkage);
+    if (F.hasAddressTaken()) {
+      continue;
+    }
+    F.setCallingConv(CallingConv::Fast);
+    for (auto U : F.users()) {
+      if (auto Call = dyn_cast<CallBase>(U)) {
+        Call->setCallingConv(CallingConv::Fast);
+      }
+    }
+  }
+  for (auto &G : M.globals()) {
+    if (G.isDeclaration() && G.getLinkage() != GlobalValue::CommonLinkage) {
+      continue;
     }
-    if (hasReadNat) {
-      // emit runtime function `readNat()`, which is just system scanf
-      Function::Create(IOType, Function::ExternalLinkage, "scanf",
-                       TheModule.get());
+    if (!G.hasInitializer()) {
+      // object-typed static fields are emitted without an initializer
+      G.setInitializer(Constant::getNullValue(G.getValueType()));
     }
+    G.setLinkage(GlobalValue::InternalLinkage);
+  }
+}
+
+void runWholeProgramPasses(Module &M) {
+  legacy::PassManager MPM;
+  // Propagate constants across calls, then into internal globals.
+  MPM.add(createIPSCCPPass());
+  MPM.add(createGlobalOptimizerPass());
+  // Pass small by-pointer arguments by value and drop unused ones.
+  MPM.add(createArgumentPromotionPass());
+  MPM.add(createDeadArgEliminationPass());
+  // Inline methods into their callers and into the VTable thunks, and thunks
+  // into call sites whose constant class and method arguments fold the
+  // dispatch chain down to one call. The cost model decides each call site,
+  // and --opt-remarks reports the ones it turned down.
+  MPM.add(createFunctionInliningPass());
+  // Delete methods, thunks and globals nothing refers to anymore.
+  MPM.add(createGlobalDCEPass());
+  MPM.run(M);
+}
+
+static PointerType *methodTableType() {
+  // struct dj_method_info *
+  auto I8Ptr = Type::getInt8PtrTy(TheContext);
+  return PointerType::getUnqual(StructType::get(I8Ptr, I8Ptr));
+}
+
+static void emitStackSwitchingMain(Function *DJmain, uint64_t size) {
+  // main(): return dj_run_on_stack(dj_main, size, table, count). the table
+  // and count start out empty until emitMethodTable fills them in
+  auto runType = FunctionType::get(
+      Builder.getInt32Ty(),
+      {DJmain->getType(), Builder.getInt64Ty(), methodTableType(),
+       Builder.getInt32Ty()},
+      false);
+  auto run = Function::Create(runType, Function::ExternalLinkage,
+                              "dj_run_on_stack", TheModule.get());
+  Function *main = createFunc(Builder, "main");
+  Builder.SetInsertPoint(createBB(main, "entry"));
+  Builder.CreateRet(Builder.CreateCall(
+      run, {DJmain, Builder.getInt64(size),
+            ConstantPointerNull::get(methodTableType()), Builder.getInt32(0)}));
+}
+
+static void emitMethodTable(Module &M) {
+  // the {address, name} pairs that dj_run_on_stack uses to say which method
+  // ran out of stack, handed to it by main. with --whole-program this runs
+  // after the whole-program passes, on the functions that survived them:
+  // taking every function's address any earlier would keep internalizeModule
+  // from making them fastcc and GlobalDCE and the inliner from deleting them
+  auto run = M.getFunction("dj_run_on_stack");
+  if (run == nullptr) {
+    return;
+  }
+  auto I8Ptr = Type::getInt8PtrTy(TheContext);
+  auto EntryType = StructType::get(I8Ptr, I8Ptr);
+  std::vector<Constant *> entries;
+  for (auto &F : M) {
+    // the runtime's fast paths linked into M are not methods
+    if (F.isDeclaration() ||
+        (F.getName().startswith("dj_") && F.getName() != "dj_main")) {
+      continue;
+    }
+    auto NameData = ConstantDataArray::getString(TheContext, djNameOf(F));
+    auto Name = new GlobalVariable(M, NameData->getType(), true,
+                                   GlobalValue::PrivateLinkage, NameData,
+                                   "methodname");
+    entries.push_back(ConstantStruct::get(
+        EntryType, {ConstantExpr::getBitCast(&F, I8Ptr),
+                    ConstantExpr::getBitCast(Name, I8Ptr)}));
+  }
+  auto TableType = ArrayType::get(EntryType, entries.size());
+  auto Table = new GlobalVariable(M, TableType, true,
+                                  GlobalValue::PrivateLinkage,
+                                  ConstantArray::get(TableType, entries),
+                                  "dj_method_table");
+  for (auto U : run->users()) {
+    if (auto Call = dyn_cast<CallInst>(U)) {
+      Call->setArgOperand(2, ConstantExpr::getBitCast(Table,
+                                                      methodTableType()));
+      Call->setArgOperand(3, Builder.getInt32(entries.size()));
+    }
+  }
+}
+
+Function *DJProgram::codeGen(symbolTable ST, int type) {
+  TheModule = std::make_unique<Module>(inputFile, TheContext);
+  emitReadPrompt = promptOnRead;
+  pruneDeadCode = pruneUnreachable;
+  liveClasses = instantiatedClasses;
+  liveMethods = reachableMethods;
+  checkNulls = nullChecks;
+  countAllocations = heapStats;
+  traceCalls = trace;
+  traceIDs.clear();
+  traceNames.clear();
+  nullReportNames.clear();
+  freeSlots.clear();
+  // the remarks are only useful with DJ lines, which come from the line table
+  emitDebugInfo = debugInfo || !remarksFile.empty();
+  debugLinesOnly = !debugInfo;
+  DebugScope = nullptr;
+  Builder.SetCurrentDebugLocation(DebugLoc());
+
+  // the target machine is needed before optimizing: the data layout and the
+  // target's cost model drive the loop vectorizer and unroller. the debug
+  // info needs the pointer size from the data layout
+  auto TargetMachine = createTargetMachine(target);
+  TheModule->setDataLayout(TargetMachine->createDataLayout());
+  TheModule->setTargetTriple(TargetMachine->getTargetTriple().str());
+  if (emitDebugInfo) {
+    beginDebugInfo(runOptimizations);
+  }
+
+  if (hasPrintNat) {
+    // emit runtime function `printNat()`, which is dj_print_nat in
+    // runtimeFastPaths.c
+    FunctionType *printType = FunctionType::get(
+        Builder.getVoidTy(), {Builder.getInt32Ty()}, false);
+    Function::Create(printType, Function::ExternalLinkage, "dj_print_nat",
+                     TheModule.get());
+  }
+  // `new` calls dj_alloc; when nothing does, it is dropped after linking
+  auto alloc = Function::Create(
+      FunctionType::get(Builder.getInt8PtrTy(), {Builder.getInt64Ty()}, false),
+      Function::ExternalLinkage, "dj_alloc", TheModule.get());
+  alloc->setReturnDoesNotAlias();
+  if (hasReadNat) {
+    // emit runtime function `readNat()`, which is dj_read_nat in runtime.c
+    FunctionType *readType = FunctionType::get(
+        Builder.getInt32Ty(), {Builder.getInt32Ty()}, false);
+    Function::Create(readType, Function::ExternalLinkage, "dj_read_nat",
+                     TheModule.get());
+  }
+  // see runtime.h. direct tail calls check their receiver even without
+  // --null-checks
+  auto nullDeref = Function::Create(
+      FunctionType::get(Builder.getVoidTy(),
+                        {Builder.getInt32Ty(), Builder.getInt8PtrTy()}, false),
+      Function::ExternalLinkage, "dj_null_deref", TheModule.get());
+  nullDeref->setDoesNotReturn();
+  nullDeref->addFnAttr(Attribute::Cold);
+  if (checkNulls) {
+    // see runtime.h
+    Function::Create(FunctionType::get(Builder.getVoidTy(), false),
+                     Function::ExternalLinkage, "dj_enable_null_checks",
+                     TheModule.get());
+  }
+  if (traceCalls) {
+    // see runtime.h
+    Function::Create(
+        FunctionType::get(Builder.getVoidTy(),
+                          {Builder.getInt8PtrTy()->getPointerTo(),
+                           Builder.getInt32Ty()},
+                          false),
+        Function::ExternalLinkage, "dj_enable_tracing", TheModule.get());
+    Function::Create(
+        FunctionType::get(Builder.getVoidTy(), {Builder.getInt32Ty()}, false),
+        Function::ExternalLinkage, "dj_trace", TheModule.get());
+  }
+  if (countAllocations) {
+    // see runtime.h
+    Function::Create(
+        FunctionType::get(Builder.getVoidTy(),
+                          {Builder.getInt8PtrTy()->getPointerTo(),
+                           Builder.getInt32Ty(), Builder.getInt32Ty()},
+                          false),
+        Function::ExternalLinkage, "dj_enable_heap_stats", TheModule.get());
+    Function::Create(FunctionType::get(Builder.getVoidTy(),
+                                       {Builder.getInt32Ty(),
+                                        Builder.getInt64Ty()},
+                                       false),
+                     Function::ExternalLinkage, "dj_count_allocation",
+                     TheModule.get());
   }
   for (int i = 0; i < numClasses; i++) {
     allocatedClasses[classesST[i].className] =
@@ -399,6 +1221,9 @@ Function *DJProgram::codeGen(symbolTable ST, int type) {
     for (int j = 0; j < classST.numMethods; j++) {
       auto methodST = classST.methodList[j];
       auto methodName = declaredClass + "_method_" + methodST.methodName;
+      if (!methodIsLive(i, j)) {
+        continue;
+      }
       if (TheModule->getFunction(methodName) == nullptr) {
         functionArgs = {getLLVMTypeFromDJType(declaredClass),
                         getLLVMTypeFromDJType(methodST.paramType)};
@@ -410,6 +1235,20 @@ Function *DJProgram::codeGen(symbolTable ST, int type) {
     }
     classST = classesST[classST.superclass];
   }
+  if (traceCalls) {
+    traceIDs[stackSize ? "dj_main" : "main"] = 0;
+    traceNames.push_back("main");
+    for (int i = 0; i < numClasses; i++) {
+      for (int j = 0; j < classesST[i].numMethods; j++) {
+        if (methodIsLive(i, j)) {
+          auto className = std::string(classesST[i].className);
+          auto methodName = std::string(classesST[i].methodList[j].methodName);
+          traceIDs[className + "_method_" + methodName] = traceNames.size();
+          traceNames.push_back(className + "." + methodName);
+        }
+      }
+    }
+  }
   emitVTable();
 
   // emit method definitions
@@ -419,37 +1258,92 @@ Function *DJProgram::codeGen(symbolTable ST, int type) {
     for (int j = 0; j < classST.numMethods; j++) {
       auto methodST = classST.methodList[j];
       auto methodName = declaredClass + "_method_" + methodST.methodName;
+      if (!methodIsLive(i, j)) {
+        continue;
+      }
       auto method = TheModule->getFunction(methodName);
       Builder.SetInsertPoint(createBB(method, "entry"));
-      generateMethodST(i, j);
+      beginDebugFunction(method, declaredClass + "." + methodST.methodName,
+                         methodST.methodNameLineNumber,
+                         {methodST.returnType, i, methodST.paramType});
+      // before the loop header, so that a self-recursive tail call, which
+      // jumps there, stays inside the one B/E pair
+      emitTraceEvent(methodName, DJ_TRACE_BEGIN);
+      generateMethodST(i, j, selfTailRecursive.count(methodName));
       Value *last = nullptr;
-      for (const auto &e : translateExprList(methodST.bodyExprs)) {
+      for (const auto &e : methodBodies[methodName]) {
+        setDebugLine(e->lineNumber);
         last = e->codeGen(NamedValues[methodName]);
       }
       if (methodST.returnType >= OBJECT_TYPE) {
         last = Builder.CreatePointerCast(
             last, getLLVMTypeFromDJType(methodST.returnType));
       }
+      emitTraceEnd(methodName, last);
       Builder.CreateRet(last);
+      endDebugFunction();
     }
   }
 
   /*begin codegen for `main`*/
-  Function *DJmain = createFunc(Builder, "main");
+  TailRecurseBB = nullptr;
+  // with --stack-size the real main only switches stacks and calls this
+  Function *DJmain = createFunc(Builder, stackSize ? "dj_main" : "main");
   BasicBlock *entry = createBB(DJmain, "entry");
 
   std::map<std::string, llvm::AllocaInst *> MainSymbolTable;
   Builder.SetInsertPoint(entry);
+  beginDebugFunction(DJmain, "main",
+                     mainExprs.empty() ? 1 : mainExprs[0]->lineNumber,
+                     {TYPE_NAT});
+  if (checkNulls) {
+    Builder.CreateCall(TheModule->getFunction("dj_enable_null_checks"));
+  }
+  if (traceCalls) {
+    std::vector<Constant *> names;
+    for (const auto &name : traceNames) {
+      names.push_back(cast<Constant>(Builder.CreateGlobalStringPtr(name)));
+    }
+    auto namesType = ArrayType::get(Builder.getInt8PtrTy(), names.size());
+    auto namesTable = new GlobalVariable(
+        *TheModule, namesType, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(namesType, names), "traceNames");
+    Builder.CreateCall(
+        TheModule->getFunction("dj_enable_tracing"),
+        {Builder.CreateConstInBoundsGEP2_32(namesType, namesTable, 0, 0),
+         Builder.getInt32(names.size())});
+    emitTraceEvent(DJmain->getName().str(), DJ_TRACE_BEGIN);
+  }
+  if (countAllocations) {
+    // the runtime reports classes by name, indexed by class number
+    std::vector<Constant *> names;
+    for (int i = 0; i < numClasses; i++) {
+      names.push_back(cast<Constant>(
+          Builder.CreateGlobalStringPtr(classesST[i].className)));
+    }
+    auto namesType = ArrayType::get(Builder.getInt8PtrTy(), numClasses);
+    auto namesTable = new GlobalVariable(
+        *TheModule, namesType, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(namesType, names), "classNames");
+    Builder.CreateCall(
+        TheModule->getFunction("dj_enable_heap_stats"),
+        {Builder.CreateConstInBoundsGEP2_32(namesType, namesTable, 0, 0),
+         Builder.getInt32(numClasses), Builder.getInt32(heapStatsAsJSON)});
+  }
   for (int i = 0; i < numMainBlockLocals; i++) {
     char *varName = mainBlockST[i].varName;
     auto LLType = getLLVMTypeFromDJType(mainBlockST[i].type);
-    MainSymbolTable[varName] = Builder.CreateAlloca(LLType, nullptr, varName);
+    MainSymbolTable[varName] = createEntryBlockAlloca(DJmain, LLType, varName);
     Builder.CreateStore(Constant::getNullValue(LLType),
                         MainSymbolTable[varName]);
+    declareDebugVariable(MainSymbolTable[varName], varName,
+                         mainBlockST[i].type,
+                         mainBlockST[i].varNameLineNumber, 0);
   }
   NamedValues["main"] = MainSymbolTable;
   Value *last = nullptr;
   for (auto e : mainExprs) {
+    setDebugLine(e->lineNumber);
     last = e->codeGen(NamedValues["main"]);
   }
   // adjust main's return type if needed so we don't get a type mismatch when
@@ -457,85 +1351,122 @@ Function *DJProgram::codeGen(symbolTable ST, int type) {
   if (last->getType() != Type::getInt32Ty(TheContext)) {
     last = ConstantInt::get(TheContext, APInt(32, 0));
   }
-  Builder.CreateRet(last); /*done with code gen*/
+  emitTraceEvent(DJmain->getName().str(), DJ_TRACE_END);
+  Builder.CreateRet(last);
+  endDebugFunction();
+  if (stackSize) {
+    emitStackSwitchingMain(DJmain, stackSize);
+    if (!wholeProgram) {
+      emitMethodTable(*TheModule);
+    }
+  }
+  if (emitDebugInfo) {
+    finishDebugInfo();
+  } /*done with code gen*/
   if (emitLLVM) {
     std::cout << "\n\n";
     TheModule->print(outs(), nullptr);
   }
   llvm::Module *test = TheModule.get();
   llvm::verifyModule(*test, &llvm::errs());
-  if (runOptimizations) {
-    // Create a new pass manager attached to it.
-    TheFPM = std::make_unique<legacy::FunctionPassManager>(TheModule.get());
-    // Promote allocas to registers.
-    TheFPM->add(createPromoteMemoryToRegisterPass());
-    // Do simple "peephole" optimizations and bit-twiddling optzns.
-    TheFPM->add(createInstructionCombiningPass());
-    // Reassociate expressions.
-    TheFPM->add(createReassociatePass());
-    // Eliminate Common SubExpressions.
-    TheFPM->add(createGVNPass());
-    // Simplify the control flow graph (deleting unreachable blocks, etc).
-    TheFPM->add(createCFGSimplificationPass());
-    TheFPM->doInitialization();
-    TheFPM->run(*DJmain);
-  }
-  /*begin emitting object file -- copied mostly verbatim from the kaleidoscope
-   * tutorial*/
-  auto TargetTriple = sys::getDefaultTargetTriple();
-  InitializeAllTargetInfos();
-  InitializeAllTargets();
-  InitializeAllTargetMCs();
-  InitializeAllAsmParsers();
-  InitializeAllAsmPrinters();
-  std::string Error;
-  auto Target = TargetRegistry::lookupTarget(TargetTriple, Error);
-  // Print an error and exit if we couldn't find the requested target.
-  // This generally occurs if we've forgotten to initialise the
-  // TargetRegistry or we have a bogus target triple.
-  if (!Target) {
-    errs() << Error;
-    exit(-1);
+  if (!tempsDir.empty()) {
+    if (auto EC = sys::fs::create_directories(tempsDir)) {
+      printf("ERROR: cannot create %s: %s\n", tempsDir.c_str(),
+             EC.message().c_str());
+      exit(-1);
+    }
+    saveIR(*TheModule, tempPath(tempsDir, ".ll"), false);
   }
-  std::string CPU = sys::getHostCPUName();
-  std::string Features = "";
-  StringMap<bool> HostFeatures;
-  if (!sys::getHostCPUFeatures(HostFeatures)) {
-    std::cerr << LRED "Could not determine host CPU features.\n";
-  } else {
-    SubtargetFeatures TheFeatures;
-    for (auto i : HostFeatures.keys()) {
-      if (HostFeatures[i]) {
-        TheFeatures.AddFeature(i.str());
+  // the passes and the backend only take these as command line options
+  std::vector<const char *> backendArgs = {"dj2ll"};
+  if (checkNulls) {
+    // let the backend fold the !make.implicit branches into the fault map
+    backendArgs.push_back("-enable-implicit-null-checks");
+  }
+  std::string printFilter;
+  if (!printAfterAll.empty()) {
+    // C.m -> C_method_m
+    auto function = printAfterAll == "main" ? DJmain->getName().str()
+                                            : printAfterAll;
+    auto dot = function.find('.');
+    if (dot != std::string::npos) {
+      function.replace(dot, 1, "_method_");
+    }
+    if (TheModule->getFunction(function) == nullptr) {
+      printf("ERROR: --print-after-all: no method %s is generated\n",
+             printAfterAll.c_str());
+      exit(-1);
+    }
+    printFilter = "-filter-print-funcs=" + function;
+    backendArgs.push_back("-print-after-all");
+    backendArgs.push_back(printFilter.c_str());
+  }
+  if (backendArgs.size() > 1) {
+    cl::ParseCommandLineOptions(backendArgs.size(), backendArgs.data());
+  }
+  if (!remarksFile.empty()) {
+    startOptimizationRemarks(TheContext, remarksFile);
+  }
+  // the print, allocation and hook functions the module calls, so that the
+  // optimizer sees them. --incremental links them into the dispatch part.
+  // a module for another target than dj2ll's calls runtime.o's copies instead
+  linkRuntime(*TheModule, !incremental);
+  if (wholeProgram) {
+    internalizeModule(*TheModule);
+    runWholeProgramPasses(*TheModule);
+    emitMethodTable(*TheModule);
+  }
+  if (incremental) {
+    if (stats) {
+      if (runOptimizations) {
+        printf("(before optimization, which --incremental runs per class)\n");
       }
+      printModuleStats(*TheModule);
+    }
+    // everything that changes the machine code but not the IR
+    auto config = TargetMachine->getTargetTriple().str() + " " +
+                  TargetMachine->getTargetCPU().str() + " " +
+                  TargetMachine->getTargetFeatureString().str() + " " +
+                  std::to_string(TargetMachine->getRelocationModel()) + " " +
+                  target.codeModel +
+                  (target.functionSections ? " sections" : "") +
+                  (runOptimizations ? " O" : " O0");
+    cachedObjects = emitIncrementally(*TheModule, TargetMachine,
+                                      runOptimizations, config,
+                                      inputFile + ".djcache");
+    if (stats) {
+      printObjectStats(cachedObjects);
+    }
+    if (!remarksFile.empty()) {
+      stopOptimizationRemarks(TheContext);
     }
-    Features = TheFeatures.getString();
+    return DJmain;
   }
-
-  TargetOptions opt;
-  auto RM = Reloc::Model::DynamicNoPIC;
-  auto TargetMachine =
-      Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
-  TheModule->setDataLayout(TargetMachine->createDataLayout());
-  TheModule->setTargetTriple(TargetTriple);
-  auto Filename = inputFile + ".o";
-  std::error_code EC;
-  raw_fd_ostream dest(Filename, EC, sys::fs::OF_None);
-
-  if (EC) {
-    errs() << "Could not open file: " << EC.message();
-    exit(-1);
+  if (runOptimizations) {
+    optimizeModule(*TheModule, TargetMachine);
   }
-  legacy::PassManager pass;
-  auto FileType = CGFT_ObjectFile;
-
-  if (TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
-    errs() << "TargetMachine can't emit a file of this type";
-    exit(-1);
+  if (stats) {
+    printModuleStats(*TheModule);
+  }
+  if (!tempsDir.empty()) {
+    // the backend rewrites the IR it compiles, so the assembly is generated
+    // from a copy, and the object file from the module as saved here
+    saveIR(*TheModule, tempPath(tempsDir, ".opt.ll"), false);
+    saveIR(*TheModule, tempPath(tempsDir, ".opt.bc"), true);
+    auto copy = CloneModule(*TheModule);
+    emitFile(*copy, TargetMachine, tempPath(tempsDir, ".s"),
+             CGFT_AssemblyFile);
+  }
+  emitObjectFile(*TheModule, TargetMachine, inputFile + ".o");
+  if (!tempsDir.empty()) {
+    sys::fs::copy_file(inputFile + ".o", tempPath(tempsDir, ".o"));
+  }
+  if (!remarksFile.empty()) {
+    stopOptimizationRemarks(TheContext);
+  }
+  if (stats) {
+    printObjectStats({inputFile + ".o"});
   }
-
-  pass.run(*TheModule);
-  dest.flush();
   return DJmain;
 }
 
@@ -553,24 +1484,17 @@ Value *DJTimes::codeGen(symbolTable ST, int type) {
 
 Value *DJPrint::codeGen(symbolTable ST, int type) {
   Value *P = printee->codeGen(ST);
-  Value *formatStr = Builder.CreateGlobalStringPtr("%u\n");
-  std::vector<Value *> PrintfArgs = {formatStr, P};
-  Function *TheFunction = TheModule->getFunction("printf");
-  Builder.CreateCall(TheFunction, PrintfArgs);
+  Builder.CreateCall(TheModule->getFunction("dj_print_nat"), {P});
   return P;
 }
 
 Value *DJRead::codeGen(symbolTable ST, int type) {
-  Value *requestStr = Builder.CreateGlobalStringPtr("Enter a natural number: ");
-  std::vector<Value *> requestArgs = {requestStr};
-  Builder.CreateCall(TheModule->getFunction("printf"), requestArgs);
-  Value *formatStr = Builder.CreateGlobalStringPtr("%u");
-  AllocaInst *Alloca =
-      Builder.CreateAlloca(Type::getInt32Ty(TheContext), nullptr, "temp");
-  std::vector<Value *> scanfArgs = {formatStr, Alloca};
-  Function *theScanf = TheModule->getFunction("scanf");
-  Builder.CreateCall(theScanf, scanfArgs);
-  return Builder.CreateLoad(Alloca);
+  // the runtime decides whether stdin is interactive enough to need the
+  // prompt; --no-prompt removes it altogether
+  std::vector<Value *> readArgs = {
+      ConstantInt::get(TheContext, APInt(32, emitReadPrompt))};
+  return Builder.CreateCall(TheModule->getFunction("dj_read_nat"), readArgs,
+                            "readtmp");
 }
 
 Value *DJNat::codeGen(symbolTable ST, int type) {
@@ -648,6 +1572,7 @@ Value *DJFalse::codeGen(symbolTable ST, int type) {
 
 Value *DJIf::codeGen(symbolTable ST, int type) {
   /*almost verbatim from LLVM kaleidescope tutorial; comments are not mine*/
+  setDebugLine(cond->lineNumber);
   Value *condValue = cond->codeGen(ST);
   condValue = Builder.CreateICmpNE(condValue,
                                    ConstantInt::get(TheContext, APInt(1, 0)));
@@ -665,6 +1590,7 @@ Value *DJIf::codeGen(symbolTable ST, int type) {
 
   Value *ThenV = nullptr;
   for (auto &e : thenBlock) {
+    setDebugLine(e->lineNumber);
     ThenV = e->codeGen(ST);
   }
 
@@ -678,6 +1604,7 @@ Value *DJIf::codeGen(symbolTable ST, int type) {
 
   Value *ElseV = nullptr;
   for (auto &e : elseBlock) {
+    setDebugLine(e->lineNumber);
     ElseV = e->codeGen(ST);
   }
 
@@ -696,57 +1623,62 @@ Value *DJIf::codeGen(symbolTable ST, int type) {
 }
 
 Value *DJFor::codeGen(symbolTable ST, int type) {
-  /*pretty similar to kaleidescope example; some modification to actually work
-   * like a for loop should, unlike the one in the tutorial*/
-
+  /*lowered as a canonical top-tested loop with a single latch:
+   *
+   *         init
+   *         br loopcond
+   * loopcond:  (header) test; br test, loopbody, afterloop
+   * loopbody:  body...;       br looplatch
+   * looplatch: update;        br loopcond    <- the only back edge
+   * afterloop:
+   *
+   * the test is generated once. LoopSimplify and LoopRotate turn this into
+   * the guarded, bottom-tested form the other loop passes expect*/
+
+  setDebugLine(init->lineNumber);
   init->codeGen(ST);
 
-  // Make the new basic block for the loop header, inserting after current
-  // block.
   Function *TheFunction = Builder.GetInsertBlock()->getParent();
-  Builder.GetInsertBlock();
-  BasicBlock *LoopBB = BasicBlock::Create(TheContext, "loop", TheFunction);
-
-  // Insert an explicit fall through from the current block to the LoopBB.
-  Builder.CreateBr(LoopBB);
+  BasicBlock *CondBB = BasicBlock::Create(TheContext, "loopcond", TheFunction);
+  BasicBlock *BodyBB = BasicBlock::Create(TheContext, "loopbody");
+  BasicBlock *LatchBB = BasicBlock::Create(TheContext, "looplatch");
+  BasicBlock *AfterBB = BasicBlock::Create(TheContext, "afterloop");
 
-  // Start insertion in LoopBB.
-  Builder.SetInsertPoint(LoopBB);
+  // Insert an explicit fall through from the current block to the header.
+  Builder.CreateBr(CondBB);
 
-  //    Compute the end condition.
+  // Compute the end condition in the header.
+  Builder.SetInsertPoint(CondBB);
+  setDebugLine(test->lineNumber);
   Value *testVal = test->codeGen(ST);
-
-  BasicBlock *BodyBB = BasicBlock::Create(TheContext, "loopbody", TheFunction);
-  BasicBlock *AfterBB =
-      BasicBlock::Create(TheContext, "afterloop", TheFunction);
-
-  // Convert condition to a bool by comparing non-equal to 0.0.
   testVal = Builder.CreateICmpNE(
       testVal, ConstantInt::get(TheContext, APInt(1, 0)), "loopcond");
-
-  // Insert the conditional branch
   Builder.CreateCondBr(testVal, BodyBB, AfterBB);
 
   // Emit the body of the loop.  This, like any other expr, can change the
   // current BB.  Note that we ignore the value computed by the body
+  TheFunction->getBasicBlockList().push_back(BodyBB);
   Builder.SetInsertPoint(BodyBB);
   for (auto &e : body) {
+    setDebugLine(e->lineNumber);
     e->codeGen(ST);
   }
-
+  Builder.CreateBr(LatchBB);
+
+  // The latch runs the update and jumps back to the header. Its branch
+  // carries the loop ID that the loop passes attach their hints and remarks
+  // to.
+  TheFunction->getBasicBlockList().push_back(LatchBB);
+  Builder.SetInsertPoint(LatchBB);
+  setDebugLine(update->lineNumber);
   update->codeGen(ST);
-  testVal = test->codeGen(ST);
-  // Convert condition to a bool by comparing non-equal to 0.0.
-  testVal = Builder.CreateICmpNE(
-      testVal, ConstantInt::get(TheContext, APInt(1, 0)), "loopcond");
-
-  // insert the "after loop" block
-  Builder.GetInsertBlock();
-
-  // Insert the conditional branch into the end of LoopEndBB.
-  Builder.CreateCondBr(testVal, BodyBB, AfterBB);
+  auto backEdge = Builder.CreateBr(CondBB);
+  auto loopID = MDNode::getDistinct(TheContext, {nullptr});
+  loopID->replaceOperandWith(0, loopID);
+  backEdge->setMetadata(LLVMContext::MD_loop, loopID);
 
   // Any new code will be inserted in AfterBB.
+  TheFunction->getBasicBlockList().push_back(AfterBB);
   Builder.SetInsertPoint(AfterBB);
 
   // for expr always returns 0.
@@ -765,8 +1697,7 @@ Value *DJId::codeGen(symbolTable ST, int type) {
     } else {
       // if the variable isn't in the symbol table and it isn't a global
       // variable, it must be a class variable. we use `this` to get at it.
-      auto IDIndex = getGEPIndex(ID, staticClassNum);
-      valToLoad = Builder.CreateGEP(Builder.CreateLoad(ST["this"]), IDIndex);
+      return loadField(Builder.CreateLoad(ST["this"]), ID, staticClassNum);
     }
   } else {
     valToLoad = ST[ID];
@@ -794,9 +1725,7 @@ Value *DJAssign::codeGen(symbolTable ST, int type) {
         // we are in a method and the requested variable is not a static
         // variable nor is in in the method-local symbol table; this means it
         // must be a class variable so we look at `this`
-        auto IDIndex = getGEPIndex(LHS, staticClassNum);
-        Builder.CreateStore(
-            V, Builder.CreateGEP(Builder.CreateLoad(ST["this"]), IDIndex));
+        storeField(Builder.CreateLoad(ST["this"]), LHS, staticClassNum, V);
         return V;
       }
     }
@@ -826,27 +1755,31 @@ int getClassID(std::string name) {
 }
 
 Value *DJNew::codeGen(symbolTable ST, int type) {
-  /* allocate a DJ class using system malloc, setting the `this` pointer and
-   * the class ID */
+  /* allocate a DJ class with the runtime's dj_alloc, setting the `this`
+   * pointer and the class ID */
   auto typeSize = ConstantExpr::getSizeOf(allocatedClasses[assignee]);
   typeSize =
       ConstantExpr::getTruncOrBitCast(typeSize, Type::getInt64Ty(TheContext));
 
-  auto I = CallInst::CreateMalloc(
-      Builder.GetInsertBlock(), Type::getInt64Ty(TheContext),
-      allocatedClasses[assignee], typeSize, nullptr, nullptr, "");
-  ST["temp"] = Builder.CreateAlloca(
-      PointerType::getUnqual(allocatedClasses[assignee]), nullptr, "temp");
-  Builder.CreateStore(Builder.Insert(I), ST["temp"]);
+  auto I = Builder.CreatePointerCast(
+      Builder.CreateCall(TheModule->getFunction("dj_alloc"), {typeSize}),
+      PointerType::getUnqual(allocatedClasses[assignee]));
+  auto temp =
+      borrowSlot(PointerType::getUnqual(allocatedClasses[assignee]), "temp");
+  Builder.CreateStore(I, temp);
 
   // store the result of malloc in the new struct's `this` pointer
-  Builder.CreateStore(
-      Builder.CreateLoad(ST["temp"]),
-      Builder.CreateGEP(Builder.CreateLoad(ST["temp"]), getThisIndex()));
+  Builder.CreateStore(Builder.CreateLoad(temp),
+                      Builder.CreateGEP(Builder.CreateLoad(temp),
+                                        getThisIndex()));
   // store the object's class in the appropriate place
-  Builder.CreateStore(
-      ConstantInt::get(TheContext, APInt(32, this->classID)),
-      Builder.CreateGEP(Builder.CreateLoad(ST["temp"]), getGEPID()));
+  Builder.CreateStore(ConstantInt::get(TheContext, APInt(32, this->classID)),
+                      Builder.CreateGEP(Builder.CreateLoad(temp), getGEPID()));
+  returnSlot(temp);
+  if (countAllocations) {
+    Builder.CreateCall(TheModule->getFunction("dj_count_allocation"),
+                       {Builder.getInt32(this->classID), typeSize});
+  }
   return I;
 }
 
@@ -861,9 +1794,9 @@ Value *DJDotId::codeGen(symbolTable ST, int type) {
     auto actualID = varInfo.second + "." + ID;
     return Builder.CreateLoad(GlobalValues[actualID]);
   } else {
-    auto IDIndex = getGEPIndex(ID, staticClassNum);
-    return Builder.CreateLoad(
-        Builder.CreateGEP(objectLike->codeGen(ST), IDIndex));
+    auto object = objectLike->codeGen(ST);
+    emitNullCheck(object, lineNumber);
+    return loadField(object, ID, staticClassNum);
   }
 }
 
@@ -882,18 +1815,19 @@ Value *DJDotAssign::codeGen(symbolTable ST, int type) {
     auto actualID = varInfo.second + "." + ID;
     Builder.CreateStore(ret, GlobalValues[actualID]);
   } else {
-    auto IDIndex = getGEPIndex(ID, staticClassNum);
+    Value *object;
     if (hasNullChild) {
-      auto I =
-          Builder.CreateGEP(objectLike->codeGen(ST, staticClassNum), IDIndex);
+      object = objectLike->codeGen(ST, staticClassNum);
       ret = assignVal->codeGen(ST, staticClassNum);
       ret =
           Builder.CreatePointerCast(ret, getLLVMTypeFromDJType(staticClassNum));
-      Builder.CreateStore(ret, I);
     } else {
-      auto I = Builder.CreateGEP(objectLike->codeGen(ST), IDIndex);
-      Builder.CreateStore(ret, I);
+      object = objectLike->codeGen(ST);
     }
+    // check right before the store, so the store (or, for a bool, the load
+    // of its bitfield word) is what faults
+    emitNullCheck(object, lineNumber);
+    storeField(object, ID, staticClassNum, ret);
   }
   return ret;
 }
@@ -942,12 +1876,77 @@ Value *DJInstanceOf::codeGen(symbolTable ST, int type) {
   return PN;
 }
 
+Value *emitKnownTargetCall(symbolTable ST, Value *receiver,
+                           DJExpression *methodParameter,
+                           std::string paramName, int paramDeclaredType,
+                           int targetClass, int targetMethod,
+                           bool receiverMayBeNull, unsigned line) {
+  // a call in tail position whose only possible target is
+  // targetClass.targetMethod: call that method directly instead of going
+  // through a VTable thunk, and if it is the method we are in, jump back to
+  // the top of it instead of calling at all
+  auto targetName = std::string(classesST[targetClass].className) +
+                    "_method_" +
+                    classesST[targetClass].methodList[targetMethod].methodName;
+  Value *param = paramDeclaredType >= OBJECT_TYPE
+                     ? methodParameter->codeGen(ST, paramDeclaredType)
+                     : methodParameter->codeGen(ST);
+  if (receiverMayBeNull) {
+    // a direct call, unlike a VTable thunk, never loads the receiver's class,
+    // so nothing would fault on null. check explicitly, with or without
+    // --null-checks
+    emitNullBranch(receiver, line, false);
+  }
+  Function *TheFunction = Builder.GetInsertBlock()->getParent();
+  if (TailRecurseBB != nullptr && TheFunction->getName() == targetName) {
+    // rebind `this` and the parameter; the receiver is evaluated before the
+    // argument, as it would be for a real call
+    Builder.CreateStore(Builder.CreatePointerCast(
+                            receiver, ST["this"]->getAllocatedType()),
+                        ST["this"]);
+    if (paramDeclaredType >= OBJECT_TYPE) {
+      param =
+          Builder.CreatePointerCast(param, ST[paramName]->getAllocatedType());
+    }
+    Builder.CreateStore(param, ST[paramName]);
+    Builder.CreateBr(TailRecurseBB);
+    // nothing after the jump runs, but our callers still expect a value and
+    // an open block to keep emitting into
+    Builder.SetInsertPoint(
+        BasicBlock::Create(TheContext, "aftertail", TheFunction));
+    return UndefValue::get(TheFunction->getReturnType());
+  }
+  Function *callee = TheModule->getFunction(targetName);
+  std::vector<Value *> args = {
+      Builder.CreatePointerCast(receiver, callee->getArg(0)->getType()),
+      param};
+  if (paramDeclaredType >= OBJECT_TYPE) {
+    args[1] = Builder.CreatePointerCast(param, callee->getArg(1)->getType());
+  }
+  CallInst *call = Builder.CreateCall(callee, args);
+  call->setTailCall();
+  return call;
+}
+
 Value *DJDotMethodCall::codeGen(symbolTable ST, int type) {
+  if (isTailCall && targetClass != -1) {
+    Value *ret = emitKnownTargetCall(ST, objectLike->codeGen(ST),
+                                     methodParameter, paramName,
+                                     paramDeclaredType, targetClass,
+                                     targetMethod, true, lineNumber);
+    if (classesST[staticClassNum].methodList[staticMemberNum].returnType >=
+        OBJECT_TYPE) {
+      ret =
+          Builder.CreatePointerCast(ret, getLLVMTypeFromDJType(staticClassNum));
+    }
+    return ret;
+  }
   auto className = std::string(typeString(staticClassNum));
   auto LLMethodName = className + "_method_" + methodName;
   symbolTable methodST = NamedValues[LLMethodName];
-  std::vector<Value *> methodArgs = {Builder.CreatePointerCast(
-      objectLike->codeGen(ST), getLLVMTypeFromDJType("Object"))};
+  Value *receiver = objectLike->codeGen(ST);
+  std::vector<Value *> methodArgs = {
+      Builder.CreatePointerCast(receiver, getLLVMTypeFromDJType("Object"))};
   methodArgs.push_back(ConstantInt::get(TheContext, APInt(32, staticClassNum)));
   methodArgs.push_back(
       ConstantInt::get(TheContext, APInt(32, staticMemberNum)));
@@ -957,6 +1956,12 @@ Value *DJDotMethodCall::codeGen(symbolTable ST, int type) {
   } else {
     methodArgs.push_back(methodParameter->codeGen(ST));
   }
+  if (checkNulls) {
+    // the load of the receiver's class is what faults on null
+    emitNullCheck(receiver, lineNumber);
+    methodArgs.push_back(
+        Builder.CreateLoad(Builder.CreateGEP(receiver, getGEPID())));
+  }
   int declRet =
       classesST[staticClassNum].methodList[staticMemberNum].returnType;
   int declParam =
@@ -976,7 +1981,9 @@ Value *DJDotMethodCall::codeGen(symbolTable ST, int type) {
   std::string VTable = VTableRet + "VTable" + VTableParam;
 
   Function *TheFunction = TheModule->getFunction(VTable);
-  Value *ret = Builder.CreateCall(TheFunction, methodArgs);
+  CallInst *call = Builder.CreateCall(TheFunction, methodArgs);
+  call->setTailCall(isTailCall);
+  Value *ret = call;
   if (classesST[staticClassNum].methodList[staticMemberNum].returnType >=
       OBJECT_TYPE) {
     ret = Builder.CreatePointerCast(ret, getLLVMTypeFromDJType(staticClassNum));
@@ -989,6 +1996,18 @@ Value *DJThis::codeGen(symbolTable ST, int type) {
 }
 
 Value *DJUndotMethodCall::codeGen(symbolTable ST, int type) {
+  if (isTailCall && targetClass != -1) {
+    Value *ret = emitKnownTargetCall(ST, Builder.CreateLoad(ST["this"]),
+                                     methodParameter, paramName,
+                                     paramDeclaredType, targetClass,
+                                     targetMethod, false, lineNumber);
+    if (classesST[staticClassNum].methodList[staticMemberNum].returnType >=
+        OBJECT_TYPE) {
+      ret =
+          Builder.CreatePointerCast(ret, getLLVMTypeFromDJType(staticClassNum));
+    }
+    return ret;
+  }
   auto className = std::string(typeString(staticClassNum));
   auto LLMethodName = className + "_method_" + methodName;
   symbolTable methodST = NamedValues[LLMethodName];
@@ -1003,6 +2022,12 @@ Value *DJUndotMethodCall::codeGen(symbolTable ST, int type) {
   } else {
     methodArgs.push_back(methodParameter->codeGen(ST));
   }
+  if (checkNulls) {
+    // `this` is never null
+    auto self = Builder.CreateLoad(ST["this"]);
+    methodArgs.push_back(
+        Builder.CreateLoad(Builder.CreateGEP(self, getGEPID())));
+  }
   int declRet =
       classesST[staticClassNum].methodList[staticMemberNum].returnType;
   int declParam =
@@ -1022,7 +2047,9 @@ Value *DJUndotMethodCall::codeGen(symbolTable ST, int type) {
   std::string VTable = VTableRet + "VTable" + VTableParam;
 
   Function *TheFunction = TheModule->getFunction(VTable);
-  Value *ret = Builder.CreateCall(TheFunction, methodArgs);
+  CallInst *call = Builder.CreateCall(TheFunction, methodArgs);
+  call->setTailCall(isTailCall);
+  Value *ret = call;
   if (classesST[staticClassNum].methodList[staticMemberNum].returnType >=
       OBJECT_TYPE) {
     ret = Builder.CreatePointerCast(ret, getLLVMTypeFromDJType(staticClassNum));
@@ -4,6 +4,7 @@
 #include "llvm_includes.hpp"
 #include "util.h"
 #include <fstream>
+#include <string>
 
 void generateLL(std::ofstream &outputFile);
 
@@ -13,6 +14,26 @@ void codeGenExprs(ASTree *expList, int classNumber, int methodNumber);
 llvm::Type *getLLVMTypeFromDJType(std::string djType);
 llvm::Type *getLLVMTypeFromDJType(int djType);
 
+// --target, --mcpu, --mattr, --relocation-model and --code-model. empty
+// strings mean the host (for the first three) or dj2ll's defaults
+struct TargetSelection {
+  std::string triple;
+  std::string cpu;
+  std::string features;
+  std::string relocationModel;
+  std::string codeModel;
+  // a section per function and global, for --link=gc
+  bool functionSections = false;
+};
+
+llvm::TargetMachine *
+createTargetMachine(const TargetSelection &selection = TargetSelection());
+void internalizeModule(llvm::Module &M);
+void runWholeProgramPasses(llvm::Module &M);
+void optimizeModule(llvm::Module &M, llvm::TargetMachine *TM);
+void emitObjectFile(llvm::Module &M, llvm::TargetMachine *TM,
+                    std::string Filename);
+
 extern ASTree *wholeProgram;
 // The expression list in the main block of the DJ program
 extern ASTree *mainExprs;
@@ -0,0 +1,220 @@
+/*
+** compileServer.cpp
+**
+** `dj2ll --server [socket]` sets up LLVM's targets and the host target
+** machine once, then waits for dj2llc to connect. Every request is handled in
+** a forked child, so the global state the front end and code generator keep
+** (symbol tables, the LLVM context, the module) starts out fresh each time
+** while the warm parts are inherited for free. That child forks once more to
+** run the compile itself, relays what the compile writes to stdout and stderr
+** back to the client, and finishes with the compile's exit status and the
+** path of the executable it produced.
+*/
+
+#include "compileServer.hpp"
+#include "codegen.hpp"
+#include "compileServer.h"
+#include "test.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t wrote = write(fd, data, size);
+    if (wrote < 0 && errno == EINTR) {
+      continue;
+    }
+    if (wrote <= 0) {
+      return false;
+    }
+    data += wrote;
+    size -= wrote;
+  }
+  return true;
+}
+
+static bool sendFrame(int fd, char kind, const char *data, uint32_t size) {
+  char header[DJ2LL_FRAME_HEADER_SIZE];
+  header[0] = kind;
+  memcpy(header + 1, &size, sizeof(size));
+  return writeAll(fd, header, sizeof(header)) && writeAll(fd, data, size);
+}
+
+static std::vector<std::string> readRequest(int fd) {
+  // NUL-terminated strings until the client shuts down its end
+  std::string buffer;
+  char chunk[4096];
+  ssize_t got;
+  while ((got = read(fd, chunk, sizeof(chunk))) != 0) {
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got < 0) {
+      return {};
+    }
+    buffer.append(chunk, got);
+  }
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (size_t i = 0; i < buffer.size(); i++) {
+    if (buffer[i] == '\0') {
+      fields.push_back(buffer.substr(start, i - start));
+      start = i + 1;
+    }
+  }
+  return fields;
+}
+
+static void relayOutput(int client, int outPipe, int errPipe) {
+  // forward the compile's stdout and stderr as they are written, until both
+  // pipes reach end of file
+  struct pollfd fds[2] = {{outPipe, POLLIN, 0}, {errPipe, POLLIN, 0}};
+  const char kinds[2] = {DJ2LL_FRAME_STDOUT, DJ2LL_FRAME_STDERR};
+  int openPipes = 2;
+  char chunk[4096];
+  while (openPipes > 0) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    for (int i = 0; i < 2; i++) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      ssize_t got = read(fds[i].fd, chunk, sizeof(chunk));
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      if (got <= 0) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        openPipes--;
+      } else {
+        sendFrame(client, kinds[i], chunk, got);
+      }
+    }
+  }
+}
+
+static void handleRequest(int client, char *argv0,
+                          void (*compile)(int argc, char **argv)) {
+  auto fields = readRequest(client);
+  if (fields.size() < 2) {
+    std::string error = "dj2ll server: malformed request\n";
+    sendFrame(client, DJ2LL_FRAME_STDERR, error.data(), error.size());
+    int32_t status = -1;
+    sendFrame(client, DJ2LL_FRAME_STATUS, (char *)&status, sizeof(status));
+    return;
+  }
+  std::string cwd = fields[0];
+  std::string fileName = fields[1];
+  int outPipe[2], errPipe[2];
+  if (pipe(outPipe) != 0 || pipe(errPipe) != 0) {
+    return;
+  }
+  pid_t worker = fork();
+  if (worker == 0) {
+    close(client);
+    close(outPipe[0]);
+    close(errPipe[0]);
+    dup2(outPipe[1], STDOUT_FILENO);
+    dup2(errPipe[1], STDERR_FILENO);
+    close(outPipe[1]);
+    close(errPipe[1]);
+    if (chdir(cwd.c_str()) != 0) {
+      printf("ERROR: could not change directory to %s\n", cwd.c_str());
+      exit(-1);
+    }
+    std::vector<char *> args = {argv0};
+    for (size_t i = 1; i < fields.size(); i++) {
+      args.push_back(&fields[i][0]);
+    }
+    args.push_back(nullptr);
+    compile(args.size() - 1, args.data());
+    exit(0);
+  }
+  close(outPipe[1]);
+  close(errPipe[1]);
+  relayOutput(client, outPipe[0], errPipe[0]);
+  int wstatus = 0;
+  while (waitpid(worker, &wstatus, 0) < 0 && errno == EINTR) {
+  }
+  int32_t status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus)
+                                      : 128 + WTERMSIG(wstatus);
+  sendFrame(client, DJ2LL_FRAME_STATUS, (char *)&status, sizeof(status));
+  if (status == 0) {
+    // runClang names the executable after the source file, in the
+    // directory dj2ll was run from
+    auto baseName = trimFromLastOccurrence(
+        fileName.substr(0, fileName.size() - 3), "/");
+    auto path = cwd + "/" + baseName;
+    sendFrame(client, DJ2LL_FRAME_PATH, path.data(), path.size());
+  }
+}
+
+void runCompileServer(const std::string &socketPath, char *argv0,
+                      void (*compile)(int argc, char **argv)) {
+  // everything a forked request would otherwise redo: target registration,
+  // target lookup, host CPU detection and building the TargetMachine
+  createTargetMachine();
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    printf("ERROR: socket path %s is too long\n", socketPath.c_str());
+    exit(-1);
+  }
+  strcpy(address.sun_path, socketPath.c_str());
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    perror("socket");
+    exit(-1);
+  }
+  unlink(socketPath.c_str());
+  // only the user running the server may send it work
+  mode_t oldMask = umask(0077);
+  if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    perror(socketPath.c_str());
+    exit(-1);
+  }
+  umask(oldMask);
+  // request handlers are never waited for
+  signal(SIGCHLD, SIG_IGN);
+  printf("dj2ll: listening on %s\n", socketPath.c_str());
+  fflush(stdout);
+
+  for (;;) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno != EINTR) {
+        perror("accept");
+      }
+      continue;
+    }
+    if (fork() == 0) {
+      close(listener);
+      // the handler does wait for its compile
+      signal(SIGCHLD, SIG_DFL);
+      handleRequest(client, argv0, compile);
+      close(client);
+      _exit(0);
+    }
+    close(client);
+  }
+}
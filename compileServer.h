@@ -0,0 +1,38 @@
+#ifndef DJ2LL_COMPILE_SERVER_HEADER
+#define DJ2LL_COMPILE_SERVER_HEADER
+
+/* The protocol spoken between `dj2ll --server` and the dj2llc client over a
+ * Unix stream socket. Shared by compileServer.cpp and dj2llc.c.
+ *
+ * Request: the client's working directory followed by the arguments it would
+ * have given dj2ll (the .dj file first, then flags), each terminated by a NUL
+ * byte. The client then shuts down its end for writing.
+ *
+ * Reply: a sequence of frames, each a one-byte kind, a four-byte length in
+ * host byte order, and that many bytes of payload. Output frames arrive while
+ * the compile runs; a status frame and then, on success, a path frame end the
+ * reply. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DJ2LL_FRAME_STDOUT 'o' /* payload: bytes dj2ll wrote to stdout */
+#define DJ2LL_FRAME_STDERR 'e' /* payload: bytes dj2ll wrote to stderr */
+#define DJ2LL_FRAME_STATUS 's' /* payload: int32_t exit status */
+#define DJ2LL_FRAME_PATH 'p'   /* payload: absolute path of the executable */
+
+#define DJ2LL_FRAME_HEADER_SIZE 5
+
+/* $DJ2LL_SOCKET if set, otherwise a per-user socket in /tmp */
+static inline void dj2llSocketPath(char *buffer, size_t size) {
+  const char *env = getenv("DJ2LL_SOCKET");
+  if (env != NULL && *env != '\0') {
+    snprintf(buffer, size, "%s", env);
+  } else {
+    snprintf(buffer, size, "/tmp/dj2ll-%u.sock", (unsigned)getuid());
+  }
+}
+
+#endif // DJ2LL_COMPILE_SERVER_HEADER
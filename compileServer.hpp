@@ -0,0 +1,15 @@
+#ifndef COMPILESERVER_H
+#define COMPILESERVER_H
+/*`dj2ll --server`: a long-lived dj2ll that accepts compile requests from
+ * dj2llc on a Unix socket, so that the cost of starting dj2ll and setting up
+ * LLVM's targets is paid once instead of once per file. see compileServer.h
+ * for the protocol*/
+
+#include <string>
+
+// compile is what main() would do with argc/argv; it is run once per request,
+// in a forked child, with the request's arguments after argv[0]
+void runCompileServer(const std::string &socketPath, char *argv0,
+                      void (*compile)(int argc, char **argv));
+
+#endif // __COMPILESERVER_H_
@@ -1,4 +1,11 @@
 #include "dj2ll.hpp"
+#include "astCache.hpp"
+#include "bytecode.hpp"
+#include "rapidTypeAnalysis.hpp"
+#include "runtime.h"
+#include "simplifyAST.hpp"
+#include "sourceInput.hpp"
+#include "tailCalls.hpp"
 #include "test.hpp"
 #include <algorithm>
 #include <cstdio>
@@ -6,6 +13,7 @@
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <set>
 #include <string>
 
 ASTree *wholeProgram;
@@ -15,6 +23,13 @@ VarDecl *mainBlockST;
 int numClasses;
 ClassDecl *classesST;
 std::string inputFile;
+// runtime.o, which lives next to the dj2ll executable
+std::string runtimeObject;
+// extra arguments for the clang that links the executable
+std::string linkOptions;
+// with --incremental, the per-class objects in <file>.djcache to link instead
+// of <file>.o; they are kept for the next build
+std::vector<std::string> cachedObjects;
 int instanceOfSeen;
 int printNatSeen;
 int readNatSeen;
@@ -23,42 +38,277 @@ bool findCLIOption(char **begin, char **end, const std::string &flag) {
   return std::find(begin, end, flag) != end;
 }
 
+std::string findCLIOptionValue(char **begin, char **end,
+                               const std::string &flag) {
+  auto prefix = flag + "=";
+  for (auto arg = begin; arg != end; arg++) {
+    if (std::strncmp(*arg, prefix.c_str(), prefix.size()) == 0) {
+      return *arg + prefix.size();
+    }
+  }
+  return "";
+}
+
 void runClang() {
   auto outputFile = trimFromLastOccurrence(inputFile, "/");
-  std::string command = "clang " + inputFile + ".o" + " -o " + outputFile;
+  std::string objects;
+  for (const auto &object : cachedObjects) {
+    objects += object + " ";
+  }
+  if (cachedObjects.empty()) {
+    objects = inputFile + ".o ";
+  }
+  std::string command = "clang " + objects + runtimeObject + linkOptions +
+                        " -o " + outputFile;
   std::system(command.c_str());
-  std::string rmCommand = "rm " + inputFile + ".o";
-  std::system(rmCommand.c_str());
+  if (cachedObjects.empty()) {
+    std::string rmCommand = "rm " + inputFile + ".o";
+    std::system(rmCommand.c_str());
+  }
+}
+
+std::map<std::string, ExprList> translateMethodBodies() {
+  // translate the body of every method in classesST up front, so that passes
+  // over the LLAST see the whole program and not just the main block
+  std::map<std::string, ExprList> bodies;
+  for (int i = 0; i < numClasses; i++) {
+    auto classST = classesST[i];
+    for (int j = 0; j < classST.numMethods; j++) {
+      auto methodST = classST.methodList[j];
+      auto methodName = std::string(classST.className) + "_method_" +
+                        methodST.methodName;
+      bodies[methodName] = translateExprList(methodST.bodyExprs);
+      attachLineNumbers(methodST.bodyExprs, bodies[methodName]);
+    }
+  }
+  return bodies;
+}
+
+static void inheritLineNumber(DJExpression *e, unsigned int line) {
+  if (e->lineNumber == 0) {
+    e->lineNumber = line;
+  }
+  for (auto child : e->children()) {
+    inheritLineNumber(child, e->lineNumber);
+  }
+}
+
+void attachLineNumbers(ASTree *exprList, ExprList &exprs) {
+  // translateExprList turns each child of an expression list into one
+  // DJExpression. give each the line of its ASTree node, and give anything
+  // beneath it that has no line of its own the same one
+  std::vector<ASTree *> nodes;
+  for (ASTList *child = exprList->children; child; child = child->next) {
+    nodes.push_back(child->data);
+  }
+  if (nodes.size() != exprs.size()) {
+    return;
+  }
+  for (size_t i = 0; i < exprs.size(); i++) {
+    inheritLineNumber(exprs[i], nodes[i]->lineNumber);
+  }
+}
+
+static bool frontEndDone = false;
+
+static void explainCombinedLines() {
+  // the front end reports errors with lines of the combined source
+  if (frontEndDone) {
+    return;
+  }
+  printf("NOTE: line numbers count through the combined source:\n");
+  for (const auto &file : sourceFiles()) {
+    printf("%sline %u is line 1 of %s\n", FOURSPACES, file.second,
+           file.first.c_str());
+  }
 }
 
 void dj2ll(std::map<std::string, bool> compilerFlags, std::string fileName,
-           char **argv) {
+           char **argv, std::map<std::string, std::string> compilerValues,
+           std::vector<std::string> libraryFiles) {
   std::string extension = fileName.substr(fileName.size() - 3, fileName.size());
   inputFile = fileName.substr(0, fileName.size() - 3);
   if (extension != ".dj") {
     printf("ERROR: %s must be called on files ending with \".dj\"\n", argv[0]);
     exit(-1);
   }
+  auto compilerPath =
+      llvm::sys::fs::getMainExecutable(argv[0], (void *)&runClang);
+  runtimeObject =
+      (llvm::sys::path::parent_path(compilerPath) + "/runtime.o").str();
 
-  yyin = fopen(fileName.c_str(), "r");
-  if (yyin == nullptr) {
-    printf("ERROR: could not open file %s\n", fileName.c_str());
-    exit(-1);
+  loadSources(libraryFiles, fileName);
+  if (!libraryFiles.empty()) {
+    atexit(explainCombinedLines);
   }
-  yyparse();
-  fclose(yyin);
+  std::string cacheKey, cachePath = inputFile + ".djast";
+  if (compilerFlags["astCache"]) {
+    // the front end's output depends on the sources and these flags only
+    cacheKey = astCacheKey(std::string("simplify=") +
+                           (compilerFlags["simplify"] ? "1" : "0") +
+                           " rta=" + (compilerFlags["rta"] ? "1" : "0"));
+  }
+  DJProgram LLProgram(ExprList{});
+  if (!compilerFlags["astCache"] ||
+      !loadASTCache(cachePath, cacheKey, LLProgram)) {
+    yyparse();
 
-  setupSymbolTables(pgmAST);
-  typecheckProgram();
+    setupSymbolTables(pgmAST);
+    typecheckProgram();
 
-  auto LLProgram = translateAST(wholeProgram);
+    LLProgram = translateAST(wholeProgram);
+    attachLineNumbers(mainExprs, LLProgram.mainExprs);
+    LLProgram.methodBodies = translateMethodBodies();
+    if (compilerFlags["simplify"]) {
+      simplifyProgram(LLProgram);
+    }
+    if (compilerFlags["rta"]) {
+      rapidTypeAnalysis(LLProgram);
+    }
+    markTailCalls(LLProgram);
+    if (compilerFlags["astCache"]) {
+      saveASTCache(cachePath, cacheKey, LLProgram);
+    }
+  }
+  frontEndDone = true;
   if (compilerFlags["verbose"]) {
     LLProgram.print();
   }
+  if (compilerFlags["interpret"] || compilerFlags["tiered"]) {
+    // run the program now instead of building an executable
+    unsigned long long threshold = 0;
+    if (compilerFlags["tiered"]) {
+      threshold = 1000;
+    }
+    if (!compilerValues["tierThreshold"].empty()) {
+      char *end;
+      threshold =
+          std::strtoull(compilerValues["tierThreshold"].c_str(), &end, 10);
+      if (*end != '\0' || threshold == 0 || threshold > UINT32_MAX) {
+        printf("ERROR: --tiered expects a positive number of calls\n");
+        exit(-1);
+      }
+    }
+    fflush(stdout);
+    exit(interpretProgram(LLProgram, compilerFlags["prompt"], threshold));
+  }
 
   if (compilerFlags["codegen"]) {
     LLProgram.runOptimizations = compilerFlags["optimizations"];
     LLProgram.emitLLVM = compilerFlags["emitLLVM"];
+    LLProgram.promptOnRead = compilerFlags["prompt"];
+    LLProgram.wholeProgram = compilerFlags["wholeProgram"];
+    LLProgram.nullChecks = compilerFlags["nullChecks"];
+    LLProgram.debugInfo = compilerFlags["debugInfo"];
+    LLProgram.incremental = compilerFlags["incremental"];
+    LLProgram.stats = compilerFlags["stats"];
+    LLProgram.trace = compilerFlags["trace"];
+    LLProgram.remarksFile = compilerValues["remarksFile"];
+    LLProgram.tempsDir = compilerValues["tempsDir"];
+    LLProgram.printAfterAll = compilerValues["printAfterAll"];
+    LLProgram.heapStats = compilerFlags["heapStats"];
+    if (compilerValues["heapStats"] == "json") {
+      LLProgram.heapStatsAsJSON = true;
+    } else if (!compilerValues["heapStats"].empty()) {
+      printf("ERROR: --heap-stats takes no value or =json\n");
+      exit(-1);
+    }
+    if (LLProgram.incremental && LLProgram.wholeProgram) {
+      // internalizing would hide every method from the other objects
+      printf("ERROR: --incremental cannot be combined with --whole-program\n");
+      exit(-1);
+    }
+    LLProgram.target.triple = compilerValues["target"];
+    LLProgram.target.cpu = compilerValues["cpu"];
+    LLProgram.target.features = compilerValues["features"];
+    LLProgram.target.relocationModel = compilerValues["relocationModel"];
+    LLProgram.target.codeModel = compilerValues["codeModel"];
+    if (!LLProgram.target.triple.empty()) {
+      linkOptions += " --target=" + LLProgram.target.triple;
+    }
+    // --link profiles trade generality of the executable for startup time
+    std::set<std::string> profiles;
+    std::string profileList = compilerValues["linkProfiles"];
+    while (!profileList.empty()) {
+      auto comma = profileList.find(',');
+      auto profile = profileList.substr(0, comma);
+      if (profile != "static" && profile != "nopie" && profile != "gc" &&
+          profile != "strip" && profile != "prelink") {
+        printf("ERROR: unknown --link profile '%s'; expected static, nopie, "
+               "gc, strip or prelink\n",
+               profile.c_str());
+        exit(-1);
+      }
+      profiles.insert(profile);
+      profileList =
+          comma == std::string::npos ? "" : profileList.substr(comma + 1);
+    }
+    if (profiles.count("prelink") &&
+        (profiles.count("static") || profiles.count("nopie"))) {
+      printf("ERROR: --link=prelink is a position independent executable, "
+             "so it cannot be combined with static or nopie\n");
+      exit(-1);
+    }
+    if (profiles.count("gc") && LLProgram.nullChecks) {
+      // nothing refers to .llvm_faultmaps, so the linker would drop it
+      printf("ERROR: --link=gc cannot be combined with --null-checks\n");
+      exit(-1);
+    }
+    if (profiles.count("prelink") && LLProgram.nullChecks) {
+      // the fault map cannot go in a PIE either; see below
+      printf("ERROR: --link=prelink cannot be combined with --null-checks\n");
+      exit(-1);
+    }
+    auto &relocationModel = LLProgram.target.relocationModel;
+    if ((profiles.count("static") || profiles.count("nopie")) &&
+        relocationModel.empty()) {
+      // the executable is loaded at a fixed address, so the code needs no
+      // GOT indirection either
+      relocationModel = "static";
+    }
+    if (profiles.count("prelink")) {
+      if (relocationModel.empty()) {
+        relocationModel = "pic";
+      } else if (relocationModel != "pic") {
+        printf("ERROR: --link=prelink needs --relocation-model=pic\n");
+        exit(-1);
+      }
+      // the executable relocates itself before main, with no dynamic
+      // loader to map, search or bind shared libraries
+      linkOptions += " -static-pie";
+    } else if (relocationModel != "pic" || LLProgram.nullChecks ||
+               profiles.count("static") || profiles.count("nopie")) {
+      // code that is not position independent, which includes the default
+      // dynamic-no-pic, cannot go in a PIE. neither can the fault map of
+      // --null-checks, which holds absolute function addresses in a
+      // read-only section. --link=static and nopie ask for a fixed address
+      // even for pic code
+      linkOptions += " -no-pie";
+    } else {
+      linkOptions += " -pie";
+    }
+    if (profiles.count("static")) {
+      linkOptions += " -static";
+    }
+    if (profiles.count("gc")) {
+      // with every function and global in a section of its own, the linker
+      // drops the ones nothing refers to, such as unused runtime helpers
+      LLProgram.target.functionSections = true;
+      linkOptions += " -Wl,--gc-sections";
+    }
+    if (profiles.count("strip")) {
+      linkOptions += " -s";
+    }
+    if (!compilerValues["stackSize"].empty()) {
+      char *end;
+      auto mib = std::strtoull(compilerValues["stackSize"].c_str(), &end, 10);
+      if (*end != '\0' || mib == 0 || mib > DJ_MAX_STACK_MIB) {
+        printf("ERROR: --stack-size expects a number of MiB from 1 to %llu\n",
+               DJ_MAX_STACK_MIB);
+        exit(-1);
+      }
+      LLProgram.stackSize = mib << 20;
+    }
     symbolTable ST; /*throwaway*/
     LLProgram.codeGen(ST);
   }
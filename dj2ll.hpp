@@ -12,10 +12,19 @@ extern "C" int yyparse(void);
 extern ASTree *pgmAST;
 
 bool findCLIOption(char **begin, char **end, const std::string &flag);
+// for flags of the form --name=value: returns the value, or "" if absent
+std::string findCLIOptionValue(char **begin, char **end,
+                               const std::string &flag);
 
 void runClang();
 
+std::map<std::string, ExprList> translateMethodBodies();
+
+void attachLineNumbers(ASTree *exprList, ExprList &exprs);
+
 void dj2ll(std::map<std::string, bool> compilerFlags, std::string fileName,
-           char **argv);
+           char **argv,
+           std::map<std::string, std::string> compilerValues = {},
+           std::vector<std::string> libraryFiles = {});
 
 #endif // __DJ2LL_H_
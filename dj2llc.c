@@ -0,0 +1,135 @@
+/*
+** dj2llc.c
+**
+** The client for `dj2ll --server`. `dj2llc file.dj [flags]` behaves like
+** `dj2ll file.dj [flags]`: the server compiles the file in this directory,
+** and its output and exit status become dj2llc's. With --print-output as the
+** first argument, the path of the executable is printed after a successful
+** compile. dj2llc links against nothing but libc, so starting it is cheap.
+*/
+
+#include "compileServer.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t wrote = write(fd, data, size);
+    if (wrote < 0 && errno == EINTR) {
+      continue;
+    }
+    if (wrote <= 0) {
+      return 0;
+    }
+    data += wrote;
+    size -= (size_t)wrote;
+  }
+  return 1;
+}
+
+static int readAll(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t got = read(fd, data, size);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return 0;
+    }
+    data += got;
+    size -= (size_t)got;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  char socketPath[PATH_MAX];
+  char cwd[PATH_MAX];
+  struct sockaddr_un address;
+  int printOutput = 0;
+  int status = -1;
+  int first = 1;
+  int fd, i;
+
+  if (argc > 1 && strcmp(argv[1], "--print-output") == 0) {
+    printOutput = 1;
+    first = 2;
+  }
+  if (argc <= first) {
+    printf("Usage: %s [--print-output] filename [flags]\n", argv[0]);
+    return -1;
+  }
+  dj2llSocketPath(socketPath, sizeof(socketPath));
+  if (getcwd(cwd, sizeof(cwd)) == NULL ||
+      strlen(socketPath) >= sizeof(address.sun_path)) {
+    perror(argv[0]);
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socketPath);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    fprintf(stderr,
+            "ERROR: no dj2ll server is listening on %s; start one with "
+            "`dj2ll --server`\n",
+            socketPath);
+    return -1;
+  }
+
+  if (!writeAll(fd, cwd, strlen(cwd) + 1)) {
+    perror(argv[0]);
+    return -1;
+  }
+  for (i = first; i < argc; i++) {
+    if (!writeAll(fd, argv[i], strlen(argv[i]) + 1)) {
+      perror(argv[0]);
+      return -1;
+    }
+  }
+  shutdown(fd, SHUT_WR);
+
+  for (;;) {
+    char header[DJ2LL_FRAME_HEADER_SIZE];
+    uint32_t size;
+    char *payload;
+    if (!readAll(fd, header, sizeof(header))) {
+      break;
+    }
+    memcpy(&size, header + 1, sizeof(size));
+    payload = malloc(size + 1);
+    if (payload == NULL || !readAll(fd, payload, size)) {
+      fprintf(stderr, "ERROR: lost the connection to the dj2ll server\n");
+      return -1;
+    }
+    payload[size] = '\0';
+    switch (header[0]) {
+    case DJ2LL_FRAME_STDOUT:
+      writeAll(STDOUT_FILENO, payload, size);
+      break;
+    case DJ2LL_FRAME_STDERR:
+      writeAll(STDERR_FILENO, payload, size);
+      break;
+    case DJ2LL_FRAME_STATUS:
+      memcpy(&status, payload, sizeof(int32_t));
+      break;
+    case DJ2LL_FRAME_PATH:
+      if (printOutput) {
+        printf("%s\n", payload);
+      }
+      break;
+    }
+    free(payload);
+  }
+  close(fd);
+  return status;
+}
@@ -0,0 +1,187 @@
+/*
+** incrementalBuild.cpp
+**
+** The module dj2ll generates is split into parts: one per class, holding
+** that class's methods, and a "dispatch" part with everything else (the
+** VTable thunks, the ITable, main and the static fields). Each part is cloned
+** from the whole module, so it refers to the other parts' functions and
+** globals through declarations.
+**
+** For every part the manifest records:
+**
+**     * the layout of every class struct the part uses
+**     * the signature of every function and global it uses but does not
+**       define, i.e. what it expects of the other parts
+**     * an MD5 of the part's IR
+**
+** A part is regenerated when any of those changed, when the options in
+** `config` or the dj2ll build changed, or when its object file is missing.
+** Otherwise its object file from the last build is linked again as is. Only
+** function passes run on the parts, so optimizing a part alone produces the
+** same code as optimizing the whole module would.
+*/
+
+#include "incrementalBuild.hpp"
+#include "codegen.hpp"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace llvm;
+
+static std::string partOf(const GlobalValue &GV) {
+  // methods are named C_method_m; everything else is dispatch
+  auto name = GV.getName().str();
+  auto split = name.find("_method_");
+  if (isa<Function>(GV) && split != std::string::npos) {
+    return "class." + name.substr(0, split);
+  }
+  return "dispatch";
+}
+
+static void dropUnused(Module &M) {
+  // every part gets a copy of every private global (strings, the method
+  // table) and a declaration of everything else. keep only what this part
+  // refers to, so that its manifest record lists only what it depends on
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto G = M.global_begin(); G != M.global_end();) {
+      auto &Global = *G++;
+      if ((Global.hasLocalLinkage() || Global.isDeclaration()) &&
+          Global.use_empty()) {
+        Global.eraseFromParent();
+        changed = true;
+      }
+    }
+    for (auto F = M.begin(); F != M.end();) {
+      auto &Function = *F++;
+      if (Function.isDeclaration() && Function.use_empty() &&
+          !Function.isIntrinsic()) {
+        Function.eraseFromParent();
+        changed = true;
+      }
+    }
+  }
+}
+
+static std::unique_ptr<Module> extractPart(Module &M, const std::string &part) {
+  ValueToValueMapTy VMap;
+  auto Part = CloneModule(M, VMap, [&](const GlobalValue *GV) {
+    return GV->hasLocalLinkage() || partOf(*GV) == part;
+  });
+  dropUnused(*Part);
+  return Part;
+}
+
+static std::string describePart(Module &Part) {
+  // the manifest record for one part; it changes exactly when the part has
+  // to be regenerated
+  std::string record;
+  raw_string_ostream OS(record);
+  for (auto ST : Part.getIdentifiedStructTypes()) {
+    OS << "layout ";
+    ST->print(OS);
+    OS << "\n";
+  }
+  for (auto &F : Part) {
+    if (F.isDeclaration()) {
+      OS << "signature " << F.getName() << " ";
+      F.getFunctionType()->print(OS);
+      OS << "\n";
+    }
+  }
+  for (auto &G : Part.globals()) {
+    if (G.isDeclaration()) {
+      OS << "signature " << G.getName() << " ";
+      G.getValueType()->print(OS);
+      OS << "\n";
+    }
+  }
+  std::string IR;
+  raw_string_ostream IROS(IR);
+  Part.print(IROS, nullptr);
+  MD5 Hash;
+  Hash.update(IROS.str());
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  OS << "hash " << Result.digest() << "\n";
+  return OS.str();
+}
+
+// identifies the dj2ll build: another LLVM or another dj2ll may generate
+// different code, or code for another runtime ABI, from the same IR. make
+// compiles every source each time it builds dj2ll, so this changes with it
+static const char *compilerID =
+    "dj2ll " __DATE__ " " __TIME__ " LLVM " LLVM_VERSION_STRING;
+
+static std::map<std::string, std::string>
+readManifest(const std::string &path, const std::string &config) {
+  // part name -> the record it was built from. a manifest written for
+  // another configuration is as good as none
+  std::map<std::string, std::string> records;
+  std::ifstream manifest(path);
+  std::string line, part;
+  if (!std::getline(manifest, line) || line != "config " + config) {
+    return records;
+  }
+  while (std::getline(manifest, line)) {
+    if (line.compare(0, 5, "part ") == 0) {
+      part = line.substr(5);
+      records[part] = "";
+    } else if (!part.empty()) {
+      records[part] += line + "\n";
+    }
+  }
+  return records;
+}
+
+std::vector<std::string> emitIncrementally(Module &M, TargetMachine *TM,
+                                           bool optimize,
+                                           const std::string &config,
+                                           const std::string &cacheDir) {
+  if (auto EC = sys::fs::create_directories(cacheDir)) {
+    errs() << "Could not create " << cacheDir << ": " << EC.message() << "\n";
+    exit(-1);
+  }
+  std::set<std::string> parts = {"dispatch"};
+  for (auto &F : M) {
+    if (!F.isDeclaration()) {
+      parts.insert(partOf(F));
+    }
+  }
+  auto manifestPath = cacheDir + "/manifest";
+  auto built = std::string(compilerID) + " " + config;
+  auto previous = readManifest(manifestPath, built);
+  std::ostringstream manifest;
+  manifest << "config " << built << "\n";
+  std::vector<std::string> objects;
+  for (const auto &part : parts) {
+    auto Part = extractPart(M, part);
+    auto record = describePart(*Part);
+    auto object = cacheDir + "/" + part + ".o";
+    manifest << "part " << part << "\n" << record;
+    objects.push_back(object);
+    if (previous.count(part) && previous[part] == record &&
+        sys::fs::exists(object)) {
+      continue;
+    }
+    if (optimize) {
+      optimizeModule(*Part, TM);
+    }
+    emitObjectFile(*Part, TM, object);
+  }
+  // parts that no longer exist (deleted classes) are left out of the link;
+  // their stale objects are removed with them
+  for (const auto &old : previous) {
+    if (!parts.count(old.first)) {
+      sys::fs::remove(cacheDir + "/" + old.first + ".o");
+    }
+  }
+  std::ofstream(manifestPath) << manifest.str();
+  return objects;
+}
@@ -0,0 +1,20 @@
+#ifndef INCREMENTALBUILD_H
+#define INCREMENTALBUILD_H
+/*--incremental: split a generated module into one object per class plus one
+ * for the VTables, the ITable and main, and only regenerate the objects
+ * whose code, class layouts or method signatures changed since the last
+ * build. the objects and their manifest live in cacheDir*/
+
+#include "llvm_includes.hpp"
+#include <string>
+#include <vector>
+
+// returns the object files that make up the program; config describes every
+// option that changes code without changing the IR (target, optimization)
+std::vector<std::string> emitIncrementally(llvm::Module &M,
+                                           llvm::TargetMachine *TM,
+                                           bool optimize,
+                                           const std::string &config,
+                                           const std::string &cacheDir);
+
+#endif // __INCREMENTALBUILD_H_
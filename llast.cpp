@@ -196,3 +196,47 @@ std::string DJDotMethodCall::className() { return "DJDotMethodCall"; }
 std::string DJThis::className() { return "DJThis"; }
 
 std::string DJUndotMethodCall::className() { return "DJUndotMethodCall"; }
+
+ExprList DJExpression::children() { return {}; }
+
+ExprList DJPlus::children() { return {lhs, rhs}; }
+
+ExprList DJMinus::children() { return {lhs, rhs}; }
+
+ExprList DJTimes::children() { return {lhs, rhs}; }
+
+ExprList DJPrint::children() { return {printee}; }
+
+ExprList DJNot::children() { return {negated}; }
+
+ExprList DJEqual::children() { return {lhs, rhs}; }
+
+ExprList DJGreater::children() { return {lhs, rhs}; }
+
+ExprList DJAnd::children() { return {lhs, rhs}; }
+
+ExprList DJIf::children() {
+  ExprList ret = {cond};
+  ret.insert(ret.end(), thenBlock.begin(), thenBlock.end());
+  ret.insert(ret.end(), elseBlock.begin(), elseBlock.end());
+  return ret;
+}
+
+ExprList DJFor::children() {
+  ExprList ret = {init, test};
+  ret.insert(ret.end(), body.begin(), body.end());
+  ret.push_back(update);
+  return ret;
+}
+
+ExprList DJAssign::children() { return {RHS}; }
+
+ExprList DJDotId::children() { return {objectLike}; }
+
+ExprList DJDotAssign::children() { return {objectLike, assignVal}; }
+
+ExprList DJInstanceOf::children() { return {objectLike}; }
+
+ExprList DJDotMethodCall::children() { return {objectLike, methodParameter}; }
+
+ExprList DJUndotMethodCall::children() { return {methodParameter}; }
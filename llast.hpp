@@ -1,7 +1,10 @@
 #ifndef LLAST_H
 #define LLAST_H
+#include "codegen.hpp"
 #include "llvm_includes.hpp"
 #include "util.h"
+#include <set>
+#include <utility>
 #include <vector>
 
 /* defines class and functions for the AST that will be used to perform code
@@ -30,13 +33,59 @@ public:
   bool hasReadNat;
   bool runOptimizations;
   bool emitLLVM;
+  // when false, readNat() never prints "Enter a natural number: "
+  bool promptOnRead;
+  // internalize everything but main and run interprocedural passes
+  bool wholeProgram;
+  // set by rapidTypeAnalysis: when true, codeGen only emits method bodies and
+  // VTable entries for reachableMethods and instantiatedClasses
+  bool pruneUnreachable;
+  // when nonzero, main runs on an mmap'd stack of this many bytes (see
+  // dj_run_on_stack in runtime.c)
+  unsigned long long stackSize;
+  // guard field accesses and dispatch on null with implicit null checks
+  bool nullChecks;
+  // the machine the object file is for; the host unless told otherwise
+  TargetSelection target;
+  // -g: emit DWARF for methods, main, their variables and source lines
+  bool debugInfo;
+  // emit one object per class into <file>.djcache and only regenerate the
+  // ones that changed since the last build (see incrementalBuild.cpp)
+  bool incremental;
+  // print instruction, block, dispatch and section counts (codeGenStats.cpp)
+  bool stats;
+  // count the objects and bytes each class allocates and print them at exit,
+  // as JSON when heapStatsAsJSON is set (see dj_enable_heap_stats)
+  bool heapStats;
+  bool heapStatsAsJSON;
+  // record method entries, exits and dispatches for a Chrome trace (see
+  // dj_enable_tracing)
+  bool trace;
+  // when set, write the optimization remarks here (see optRemarks.cpp)
+  std::string remarksFile;
+  // --save-temps: write each stage's IR, the assembly and the object here
+  std::string tempsDir;
+  // print the IR of this method ("C.m", or "main") after every pass
+  std::string printAfterAll;
+  std::set<int> instantiatedClasses;
+  std::set<std::pair<int, int>> reachableMethods; // (class, method index)
+  // set by markTailCalls: methods that call themselves in tail position and
+  // therefore get a loop header that those calls jump back to
+  std::set<std::string> selfTailRecursive;
   // ClassDeclList classes;
   // VarDeclList mainDecls;
   ExprList mainExprs;
+  // translated method bodies, keyed by LLVM function name (C_method_foo)
+  std::map<std::string, ExprList> methodBodies;
   // DJProgram(ClassDeclList classes, VarDeclList mainDecls, ExprList mainExprs)
   //     : classes(classes), mainDecls(mainDecls), mainExprs(mainExprs) {}
   DJProgram(ExprList mainExprs)
-      : hasInstanceOf(false), runOptimizations(false), mainExprs(mainExprs) {}
+      : hasInstanceOf(false), hasPrintNat(false), hasReadNat(false),
+        runOptimizations(false), emitLLVM(false), promptOnRead(true),
+        wholeProgram(false), pruneUnreachable(false), stackSize(0),
+        nullChecks(false), debugInfo(false), incremental(false), stats(false),
+        heapStats(false), heapStatsAsJSON(false), trace(false),
+        mainExprs(mainExprs) {}
   // the value of type is only ever utilized in DJNull::codeGen()
   llvm::Function *codeGen(std::map<std::string, llvm::AllocaInst *> NamedValues,
                           int type = -1) override;
@@ -48,14 +97,19 @@ public:
   /*these variables are only assigned in and used from DJDotMethod, DJDotAssign,
    * DJAssign, DJEqual, and DJInstanceOf; these are the only expressions that
    * can have a child DJNull whose type is meaningful*/
-  bool hasNullChild;
-  int nullChildCount;
-  int staticClassNum;
+  bool hasNullChild = false;
+  int nullChildCount = 0;
+  int staticClassNum = 0;
   std::string staticClassName;
-  int staticMemberNum;
+  int staticMemberNum = 0;
   std::string staticMemberName;
+  // the source line this expression ends on, or 0 if unknown; reported by
+  // the null checks
+  unsigned int lineNumber = 0;
   virtual void print(int offset = 0) = 0;
   virtual std::string className() = 0;
+  // the expressions directly beneath this one, in evaluation order
+  virtual ExprList children();
 };
 
 class DJNat : public DJExpression {
@@ -96,6 +150,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJMinus : public DJExpression {
@@ -106,6 +161,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJTimes : public DJExpression {
@@ -116,6 +172,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJPrint : public DJExpression {
@@ -126,6 +183,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJRead : public DJExpression {
@@ -144,20 +202,22 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJEqual : public DJExpression {
 public:
   DJExpression *lhs, *rhs;
-  bool bothNull;
-  bool leftNull;
-  bool rightNull;
-  int nonNullType;
+  bool bothNull = false;
+  bool leftNull = false;
+  bool rightNull = false;
+  int nonNullType = 0;
   DJEqual(DJExpression *lhs, DJExpression *rhs) : lhs(lhs), rhs(rhs) {}
   llvm::Value *codeGen(std::map<std::string, llvm::AllocaInst *> NamedValues,
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJGreater : public DJExpression {
@@ -168,6 +228,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJAnd : public DJExpression {
@@ -178,6 +239,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJIf : public DJExpression {
@@ -190,6 +252,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJFor : public DJExpression {
@@ -203,6 +266,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJId : public DJExpression {
@@ -226,6 +290,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJNull : public DJExpression {
@@ -257,6 +322,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJDotAssign : public DJExpression {
@@ -270,6 +336,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJInstanceOf : public DJExpression {
@@ -282,6 +349,7 @@ public:
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJDotMethodCall : public DJExpression {
@@ -291,16 +359,23 @@ public:
   DJExpression *methodParameter;
   std::string paramName;
   int paramDeclaredType;
+  // set by markTailCalls: whether this call is the value of its method, and
+  // the only method it can dispatch to (-1 when that is not known)
+  bool isTailCall;
+  int targetClass;
+  int targetMethod;
   DJDotMethodCall(DJExpression *objectLike, std::string methodName,
                   DJExpression *methodParameter, std::string paramName,
                   int paramDeclaredType)
       : objectLike(objectLike), methodName(methodName),
         methodParameter(methodParameter), paramName(paramName),
-        paramDeclaredType(paramDeclaredType) {}
+        paramDeclaredType(paramDeclaredType), isTailCall(false),
+        targetClass(-1), targetMethod(-1) {}
   llvm::Value *codeGen(std::map<std::string, llvm::AllocaInst *> NamedValues,
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 class DJThis : public DJExpression {
@@ -318,14 +393,20 @@ public:
   DJExpression *methodParameter;
   std::string paramName;
   int paramDeclaredType;
+  // see DJDotMethodCall
+  bool isTailCall;
+  int targetClass;
+  int targetMethod;
   DJUndotMethodCall(std::string methodName, DJExpression *methodParameter,
                     std::string paramName, int paramDeclaredType)
       : methodName(methodName), methodParameter(methodParameter),
-        paramName(paramName), paramDeclaredType(paramDeclaredType) {}
+        paramName(paramName), paramDeclaredType(paramDeclaredType),
+        isTailCall(false), targetClass(-1), targetMethod(-1) {}
   llvm::Value *codeGen(std::map<std::string, llvm::AllocaInst *> NamedValues,
                        int type = -1) override;
   void print(int offset = 0) override;
   std::string className() override;
+  ExprList children() override;
 };
 
 #endif // __LLAST_H_
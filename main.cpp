@@ -1,21 +1,56 @@
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <string>
 
+#include "compileServer.h"
+#include "compileServer.hpp"
 #include "dj2ll.hpp"
 
-int main(int argc, char **argv) {
+static void compile(int argc, char **argv) {
   std::vector<std::string> availableFlags = {"--skip-codegen", "--run-optis",
-                                             "--emit-llvm", "--verbose"};
+                                             "--emit-llvm", "--verbose",
+                                             "--no-prompt", "--skip-simplify",
+                                             "--whole-program", "--skip-rta",
+                                             "--stack-size=<MiB>",
+                                             "--null-checks",
+                                             "--target=<triple>",
+                                             "--mcpu=<cpu>",
+                                             "--mattr=<+feature,-feature>",
+                                             "--relocation-model=<model>",
+                                             "--code-model=<model>", "-g",
+                                             "--incremental", "--ast-cache",
+                                             "--interpret",
+                                             "--tiered[=<calls>]", "--stats",
+                                             "--heap-stats[=json]", "--trace",
+                                             "--opt-remarks=<file>",
+                                             "--save-temps=<dir>",
+                                             "--print-after-all=<C.m|main>",
+                                             "--link=<profile,...>"};
   std::map<std::string, bool> compilerFlags;
   compilerFlags["codegen"] = true;
   compilerFlags["optimizations"] = false;
   compilerFlags["emitLLVM"] = false;
   compilerFlags["verbose"] = false;
+  compilerFlags["prompt"] = true;
+  compilerFlags["simplify"] = true;
+  compilerFlags["wholeProgram"] = false;
+  compilerFlags["rta"] = true;
+  compilerFlags["nullChecks"] = false;
+  compilerFlags["debugInfo"] = false;
+  compilerFlags["incremental"] = false;
+  compilerFlags["astCache"] = false;
+  compilerFlags["interpret"] = false;
+  compilerFlags["tiered"] = false;
+  compilerFlags["stats"] = false;
+  compilerFlags["heapStats"] = false;
+  compilerFlags["trace"] = false;
+  std::map<std::string, std::string> compilerValues;
   if (argc < 2) {
-    printf("Usage: %s filename [flags]\n", argv[0]);
+    printf("Usage: %s filename [library.dj ...] [flags]\n", argv[0]);
+    printf("       %s --server [socket]\n", argv[0]);
     printf("I know about these flags:\n");
     for (auto f : availableFlags) {
       printf("%s%s\n", FOURSPACES, f.c_str());
@@ -34,7 +69,89 @@ int main(int argc, char **argv) {
     if (findCLIOption(argv, argv + argc, "--verbose")) {
       compilerFlags["verbose"] = true;
     }
+    if (findCLIOption(argv, argv + argc, "--no-prompt")) {
+      compilerFlags["prompt"] = false;
+    }
+    if (findCLIOption(argv, argv + argc, "--skip-simplify")) {
+      compilerFlags["simplify"] = false;
+    }
+    if (findCLIOption(argv, argv + argc, "--whole-program")) {
+      compilerFlags["wholeProgram"] = true;
+    }
+    if (findCLIOption(argv, argv + argc, "--skip-rta")) {
+      compilerFlags["rta"] = false;
+    }
+    if (findCLIOption(argv, argv + argc, "--null-checks")) {
+      compilerFlags["nullChecks"] = true;
+    }
+    if (findCLIOption(argv, argv + argc, "-g")) {
+      compilerFlags["debugInfo"] = true;
+    }
+    if (findCLIOption(argv, argv + argc, "--incremental")) {
+      compilerFlags["incremental"] = true;
+    }
+    if (findCLIOption(argv, argv + argc, "--ast-cache")) {
+      compilerFlags["astCache"] = true;
+    }
+    if (findCLIOption(argv, argv + argc, "--interpret")) {
+      compilerFlags["interpret"] = true;
+    }
+    if (findCLIOption(argv, argv + argc, "--stats")) {
+      compilerFlags["stats"] = true;
+    }
+    compilerValues["tierThreshold"] =
+        findCLIOptionValue(argv, argv + argc, "--tiered");
+    if (findCLIOption(argv, argv + argc, "--tiered") ||
+        !compilerValues["tierThreshold"].empty()) {
+      compilerFlags["tiered"] = true;
+    }
+    if (findCLIOption(argv, argv + argc, "--trace")) {
+      compilerFlags["trace"] = true;
+    }
+    compilerValues["heapStats"] =
+        findCLIOptionValue(argv, argv + argc, "--heap-stats");
+    if (findCLIOption(argv, argv + argc, "--heap-stats") ||
+        !compilerValues["heapStats"].empty()) {
+      compilerFlags["heapStats"] = true;
+    }
+    compilerValues["remarksFile"] =
+        findCLIOptionValue(argv, argv + argc, "--opt-remarks");
+    compilerValues["tempsDir"] =
+        findCLIOptionValue(argv, argv + argc, "--save-temps");
+    compilerValues["printAfterAll"] =
+        findCLIOptionValue(argv, argv + argc, "--print-after-all");
+    compilerValues["linkProfiles"] =
+        findCLIOptionValue(argv, argv + argc, "--link");
+    compilerValues["stackSize"] =
+        findCLIOptionValue(argv, argv + argc, "--stack-size");
+    compilerValues["target"] =
+        findCLIOptionValue(argv, argv + argc, "--target");
+    compilerValues["cpu"] = findCLIOptionValue(argv, argv + argc, "--mcpu");
+    compilerValues["features"] =
+        findCLIOptionValue(argv, argv + argc, "--mattr");
+    compilerValues["relocationModel"] =
+        findCLIOptionValue(argv, argv + argc, "--relocation-model");
+    compilerValues["codeModel"] =
+        findCLIOptionValue(argv, argv + argc, "--code-model");
+  }
+  // any other .dj files hold classes for the program in argv[1]
+  std::vector<std::string> libraryFiles;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg[0] != '-' && arg.size() > 3 &&
+        arg.substr(arg.size() - 3) == ".dj") {
+      libraryFiles.push_back(arg);
+    }
   }
   std::string fileName = argv[1];
-  dj2ll(compilerFlags, fileName, argv);
+  dj2ll(compilerFlags, fileName, argv, compilerValues, libraryFiles);
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && std::string(argv[1]) == "--server") {
+    char socketPath[PATH_MAX];
+    dj2llSocketPath(socketPath, sizeof(socketPath));
+    runCompileServer(argc > 2 ? argv[2] : socketPath, argv[0], compile);
+  }
+  compile(argc, argv);
 }
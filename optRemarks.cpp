@@ -0,0 +1,124 @@
+/*
+** optRemarks.cpp
+**
+** Passes only build remarks when the context's diagnostic handler says it
+** wants them, so installing RemarkWriter is what turns them on, for the
+** optimizer and the backend alike. Each remark is written as one YAML
+** document as soon as it arrives:
+**
+**     --- !Missed
+**     Pass:            'inline'
+**     Name:            'TooCostly'
+**     DebugLoc:        { File: 'list.dj', Line: 12, Column: 0 }
+**     Function:        'List.sum'
+**     Args:
+**       - Callee:          'natVTablenat'
+**       ...
+**
+** Every function name is rewritten to its DJ name wherever it appears,
+** including inside argument strings. The lines come from the line table that
+** code generation emits whenever remarks are on (see DJProgram::codeGen).
+*/
+
+#include "optRemarks.hpp"
+#include "llvm/IR/DiagnosticInfo.h"
+#include <memory>
+
+using namespace llvm;
+
+static std::string djNames(StringRef text) {
+  // C_method_m -> C.m, dj_main -> main
+  std::string result = text.str();
+  size_t split;
+  while ((split = result.find("_method_")) != std::string::npos) {
+    result.replace(split, 8, ".");
+  }
+  if (result == "dj_main") {
+    result = "main";
+  }
+  return result;
+}
+
+static std::string quoted(StringRef text) {
+  // a single-quoted YAML scalar; a quote inside is doubled
+  std::string result = "'";
+  for (char c : text) {
+    if (c == '\'') {
+      result += "''";
+    } else if (c == '\n') {
+      result += ' ';
+    } else {
+      result += c;
+    }
+  }
+  return result + "'";
+}
+
+static std::string location(const DiagnosticLocation &loc) {
+  return "{ File: " + quoted(loc.getRelativePath()) +
+         ", Line: " + std::to_string(loc.getLine()) +
+         ", Column: " + std::to_string(loc.getColumn()) + " }";
+}
+
+namespace {
+struct RemarkWriter : public DiagnosticHandler {
+  std::unique_ptr<raw_fd_ostream> out;
+
+  bool isAnalysisRemarkEnabled(StringRef pass) const override {
+    // size-info reports the instruction count after every pass, which says
+    // nothing about DJ code and makes the pass manager count them
+    return pass != "size-info";
+  }
+  bool isMissedOptRemarkEnabled(StringRef) const override { return true; }
+  bool isPassedOptRemarkEnabled(StringRef) const override { return true; }
+  bool isAnyRemarkEnabled() const override { return true; }
+
+  bool handleDiagnostics(const DiagnosticInfo &DI) override {
+    auto remark = dyn_cast<DiagnosticInfoOptimizationBase>(&DI);
+    if (!remark) {
+      // errors and warnings are printed as usual
+      return false;
+    }
+    auto &os = *out;
+    os << "--- "
+       << (remark->isPassed() ? "!Passed"
+                              : remark->isMissed() ? "!Missed" : "!Analysis")
+       << "\n";
+    os << "Pass:            " << quoted(remark->getPassName()) << "\n";
+    os << "Name:            " << quoted(remark->getRemarkName()) << "\n";
+    if (remark->isLocationAvailable()) {
+      os << "DebugLoc:        " << location(remark->getLocation()) << "\n";
+    }
+    os << "Function:        "
+       << quoted(djNames(remark->getFunction().getName())) << "\n";
+    if (!remark->getArgs().empty()) {
+      os << "Args:\n";
+      for (const auto &arg : remark->getArgs()) {
+        os << "  - " << arg.Key << ": " << quoted(djNames(arg.Val)) << "\n";
+        if (arg.Loc.isValid()) {
+          os << "    DebugLoc:        " << location(arg.Loc) << "\n";
+        }
+      }
+    }
+    os << "...\n";
+    return true;
+  }
+};
+} // namespace
+
+void startOptimizationRemarks(LLVMContext &Context, const std::string &file) {
+  std::error_code EC;
+  auto out = std::make_unique<raw_fd_ostream>(file, EC, sys::fs::OF_Text);
+  if (EC) {
+    printf("ERROR: cannot write optimization remarks to %s: %s\n",
+           file.c_str(), EC.message().c_str());
+    exit(-1);
+  }
+  auto writer = std::make_unique<RemarkWriter>();
+  writer->out = std::move(out);
+  Context.setDiagnosticHandler(std::move(writer));
+}
+
+void stopOptimizationRemarks(LLVMContext &Context) {
+  Context.setDiagnosticHandler(std::make_unique<DiagnosticHandler>());
+}
@@ -0,0 +1,17 @@
+#ifndef OPTREMARKS_H
+#define OPTREMARKS_H
+/*--opt-remarks=<file>: what the optimizer did, and did not do, to each DJ
+ * method, written as the YAML that clang's -fsave-optimization-record writes
+ * (so opt-viewer.py reads it), but with C_method_m shown as C.m*/
+
+#include "llvm_includes.hpp"
+#include <string>
+
+// from now on, every remark a pass emits in Context goes to file. other
+// diagnostics are printed as before
+void startOptimizationRemarks(llvm::LLVMContext &Context,
+                              const std::string &file);
+// closes the file and puts the default handler back
+void stopOptimizationRemarks(llvm::LLVMContext &Context);
+
+#endif // __OPTREMARKS_H_
@@ -0,0 +1,93 @@
+/*
+** rapidTypeAnalysis.cpp
+**
+** Rapid type analysis (Bacon & Sweeney) for DJ. The analysis keeps three
+** sets and grows them until nothing changes:
+**
+**     * instantiated classes: every class named by a reachable `new`
+**     * call sites: every (static class, static method) pair named by a
+**       reachable method call
+**     * reachable methods: for each call site and each instantiated class
+**       that is a subtype of the call site's static class, the method that
+**       the VTable would dispatch to
+**
+** Reachability starts from the main block. A method body is scanned the first
+** time that method becomes reachable. Dispatch targets come from
+** getDynamicMethodInfo, the same function emitVTable uses, so the analysis
+** and the generated VTables always agree.
+*/
+
+#include "rapidTypeAnalysis.hpp"
+#include "codeGenClass.hpp"
+#include "llast.hpp"
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+static std::set<std::pair<int, int>> callSites;
+static std::vector<std::pair<int, int>> worklist;
+
+static void markReachable(DJProgram &program, std::pair<int, int> method) {
+  if (program.reachableMethods.insert(method).second) {
+    worklist.push_back(method);
+  }
+}
+
+static void instantiate(DJProgram &program, int classNum) {
+  if (!program.instantiatedClasses.insert(classNum).second) {
+    return;
+  }
+  for (const auto &[staticClass, staticMethod] : callSites) {
+    if (isSubtype(classNum, staticClass)) {
+      markReachable(program,
+                    getDynamicMethodInfo(staticClass, classNum, staticMethod));
+    }
+  }
+}
+
+static void addCallSite(DJProgram &program, int staticClass,
+                        int staticMethod) {
+  if (!callSites.insert({staticClass, staticMethod}).second) {
+    return;
+  }
+  for (int classNum : program.instantiatedClasses) {
+    if (isSubtype(classNum, staticClass)) {
+      markReachable(program,
+                    getDynamicMethodInfo(staticClass, classNum, staticMethod));
+    }
+  }
+}
+
+static void scan(DJProgram &program, DJExpression *e) {
+  if (auto newExpr = dynamic_cast<DJNew *>(e)) {
+    instantiate(program, newExpr->classID);
+  } else if (dynamic_cast<DJDotMethodCall *>(e) ||
+             dynamic_cast<DJUndotMethodCall *>(e)) {
+    addCallSite(program, e->staticClassNum, e->staticMemberNum);
+  }
+  for (auto child : e->children()) {
+    scan(program, child);
+  }
+}
+
+void rapidTypeAnalysis(DJProgram &program) {
+  program.instantiatedClasses.clear();
+  program.reachableMethods.clear();
+  callSites.clear();
+  worklist.clear();
+  for (auto e : program.mainExprs) {
+    scan(program, e);
+  }
+  while (!worklist.empty()) {
+    auto [classNum, methodNum] = worklist.back();
+    worklist.pop_back();
+    auto methodName = std::string(classesST[classNum].className) +
+                      "_method_" +
+                      classesST[classNum].methodList[methodNum].methodName;
+    for (auto e : program.methodBodies[methodName]) {
+      scan(program, e);
+    }
+  }
+  program.pruneUnreachable = true;
+}
@@ -0,0 +1,11 @@
+#ifndef RAPIDTYPEANALYSIS_H
+#define RAPIDTYPEANALYSIS_H
+/*rapid type analysis over the LLAST: starting from the main block, find the
+ * classes the program can ever instantiate and the methods that can ever be
+ * called on them, so that codeGen can skip everything else*/
+
+#include "llast.hpp"
+
+void rapidTypeAnalysis(DJProgram &program);
+
+#endif // __RAPIDTYPEANALYSIS_H_
@@ -0,0 +1,799 @@
+/*
+** runtime.c
+**
+** Runtime support for the executables that dj2ll produces. dj2ll links
+** runtime.o into every program it compiles.
+**
+** readNat() used to be a printf of a prompt followed by scanf("%u") on every
+** call, which made programs that read a lot of input spend most of their time
+** inside stdio. dj_read_nat() instead reads stdin in large blocks (or maps it
+** outright when stdin is a regular file) and parses digits eight at a time
+** when it can.
+**
+** dj_run_on_stack() runs the program on a stack that dj2ll's --stack-size
+** chose, so that deep non-tail recursion does not depend on `ulimit -s`. The
+** stack is mapped with a guard region below it; a fault in the guard region
+** is reported as "stack exhausted at method X" rather than a bare SIGSEGV.
+**
+** dj_enable_null_checks() backs dj2ll's --null-checks. The generated code has
+** no compare-and-branch for null on its field accesses and dispatches; the
+** backend turned them into plain loads and stores and listed each one, along
+** with the address of its null handler, in the .llvm_faultmaps section. When
+** one of those instructions faults, the SIGSEGV handler below finds it in the
+** fault map and resumes at the handler, which reports the DJ line.
+**
+** dj_enable_heap_stats() backs --heap-stats. Every `new` reports its class
+** and the size of the class's struct through dj_count_allocation(); the
+** totals are printed to stderr when the program exits.
+**
+** dj_enable_tracing() backs --trace. Each method entry, exit and VTable
+** dispatch stores the time stamp counter and an event number in a ring
+** buffer, which costs a few nanoseconds and never allocates. The buffer is
+** converted to Chrome trace JSON only when it is written out, with nothing
+** but write() and integer formatting, so that a signal handler can write it
+** while the program is stopped anywhere.
+**
+** The functions generated code calls on every `new`, printNat() and traced
+** call are not here but in runtimeFastPaths.c, which dj2ll links into the
+** program's module so that they can be inlined. runtimeInternal.h holds the
+** state the two files share. The end of this file includes weak out-of-line
+** copies of them, for programs cross-compiled with --target.
+*/
+
+#define _GNU_SOURCE
+#include "runtime.h"
+#include "runtimeInternal.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ucontext.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READ_BLOCK_SIZE (1 << 16)
+
+static char readBuffer[READ_BLOCK_SIZE];
+static const char *readCursor = NULL;
+static const char *readEnd = NULL;
+static int inputMapped = 0;
+static int inputExhausted = 0;
+static int inputInitialized = 0;
+static int stdinIsTerminal = 0;
+
+static void initInput(void) {
+  struct stat st;
+  inputInitialized = 1;
+  stdinIsTerminal = isatty(STDIN_FILENO);
+  if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    // stdin is something like `./prog < numbers.txt`; map the whole file and
+    // start from wherever the file offset currently is
+    off_t start = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                     STDIN_FILENO, 0);
+    if (map != MAP_FAILED && start >= 0 && start <= st.st_size) {
+      madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+      readCursor = (const char *)map + start;
+      readEnd = (const char *)map + st.st_size;
+      inputMapped = 1;
+      return;
+    }
+  }
+  readCursor = readEnd = readBuffer;
+}
+
+static int refill(void) {
+  // returns nonzero iff there is at least one more byte to read
+  ssize_t got;
+  if (inputMapped || inputExhausted) {
+    inputExhausted = 1;
+    return 0;
+  }
+  do {
+    got = read(STDIN_FILENO, readBuffer, READ_BLOCK_SIZE);
+  } while (got < 0 && errno == EINTR);
+  if (got <= 0) {
+    inputExhausted = 1;
+    return 0;
+  }
+  readCursor = readBuffer;
+  readEnd = readBuffer + got;
+  return 1;
+}
+
+static inline int isSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int isDigit(char c) { return (unsigned char)(c - '0') < 10; }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// SWAR digit parsing: check and convert eight ASCII digits held in one 64-bit
+// word without a branch per character
+static inline int eightDigits(uint64_t chunk) {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+          (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+         0x3333333333333333ULL;
+}
+
+static inline uint32_t parseEightDigits(uint64_t chunk) {
+  chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+  chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+  return (uint32_t)(((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >>
+                    32);
+}
+#endif
+
+unsigned int dj_read_nat(int prompt) {
+  unsigned int value = 0;
+  int negate = 0;
+  if (!inputInitialized) {
+    initInput();
+  }
+  if (prompt && stdinIsTerminal) {
+    fputs("Enter a natural number: ", stdout);
+    fflush(stdout);
+  }
+  // skip leading whitespace and accept an optional sign, like scanf("%u")
+  for (;;) {
+    if (readCursor == readEnd && !refill()) {
+      return 0;
+    }
+    if (!isSpace(*readCursor)) {
+      break;
+    }
+    readCursor++;
+  }
+  if (*readCursor == '+' || *readCursor == '-') {
+    negate = *readCursor == '-';
+    readCursor++;
+  }
+  for (;;) {
+    if (readCursor == readEnd && !refill()) {
+      break;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (readEnd - readCursor >= 8) {
+      uint64_t chunk;
+      memcpy(&chunk, readCursor, sizeof(chunk));
+      if (!eightDigits(chunk)) {
+        break;
+      }
+      value = value * 100000000u + parseEightDigits(chunk);
+      readCursor += 8;
+    }
+#endif
+    while (readCursor != readEnd && isDigit(*readCursor)) {
+      value = value * 10u + (unsigned int)(*readCursor - '0');
+      readCursor++;
+    }
+    if (readCursor != readEnd) {
+      break;
+    }
+  }
+  return negate ? 0u - value : value;
+}
+
+#define GUARD_SIZE (1 << 16)
+#define SIGNAL_STACK_SIZE (1 << 16)
+// a null object's fields all live within this many bytes of address 0
+#define NULL_PAGE_SIZE 4096
+
+static char *guardLow = NULL;
+static char *guardHigh = NULL;
+static const struct dj_method_info *methodTable = NULL;
+static unsigned int methodCount = 0;
+// the executable's load bias and the span of its executable segments
+static uintptr_t textBias = 0;
+static uintptr_t textLow = 0;
+static uintptr_t textHigh = 0;
+static char signalStack[SIGNAL_STACK_SIZE];
+static ucontext_t callerContext;
+static ucontext_t djContext;
+static int (*djEntry)(void) = NULL;
+static int djResult = 0;
+
+static uintptr_t faultingPC(void *context) {
+  ucontext_t *uc = (ucontext_t *)context;
+#if defined(__x86_64__)
+  return (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+  return (uintptr_t)uc->uc_mcontext.pc;
+#else
+  (void)uc;
+  return 0;
+#endif
+}
+
+static int setPC(void *context, uintptr_t pc) {
+  ucontext_t *uc = (ucontext_t *)context;
+#if defined(__x86_64__)
+  uc->uc_mcontext.gregs[REG_RIP] = (greg_t)pc;
+  return 1;
+#elif defined(__aarch64__)
+  uc->uc_mcontext.pc = pc;
+  return 1;
+#else
+  (void)uc;
+  (void)pc;
+  return 0;
+#endif
+}
+
+static int executableLoadBias(struct dl_phdr_info *info, size_t size,
+                              void *bias) {
+  // the first object dl_iterate_phdr reports is the executable itself
+  (void)size;
+  *(uintptr_t *)bias = (uintptr_t)info->dlpi_addr;
+  return 1;
+}
+
+static int executableText(struct dl_phdr_info *info, size_t size,
+                          void *unused) {
+  // the executable's code: every segment it maps executable
+  int i;
+  (void)size;
+  (void)unused;
+  textBias = (uintptr_t)info->dlpi_addr;
+  for (i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *segment = &info->dlpi_phdr[i];
+    uintptr_t low = textBias + segment->p_vaddr;
+    if (segment->p_type != PT_LOAD || !(segment->p_flags & PF_X)) {
+      continue;
+    }
+    if (textLow == textHigh || low < textLow) {
+      textLow = low;
+    }
+    if (low + segment->p_memsz > textHigh) {
+      textHigh = low + segment->p_memsz;
+    }
+  }
+  return 1;
+}
+
+static const ElfW(Ehdr) *mapExecutable(size_t *size) {
+  // our own ELF file, mapped read-only, or NULL if it cannot be read. makes
+  // nothing but system calls, so the fault handler may use it too
+  const ElfW(Ehdr) *header;
+  struct stat st;
+  void *image;
+  int fd = open("/proc/self/exe", O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 ||
+      (image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+          MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+  header = (const ElfW(Ehdr) *)image;
+  if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_shoff == 0 ||
+      header->e_shstrndx == SHN_UNDEF) {
+    munmap(image, (size_t)st.st_size);
+    return NULL;
+  }
+  *size = (size_t)st.st_size;
+  return header;
+}
+
+static long long functionSize(uintptr_t start) {
+  // the size the symbol table gives the function at start, or -1 when the
+  // executable was stripped or has no symbol there
+  const ElfW(Ehdr) *header;
+  const ElfW(Shdr) *sections;
+  size_t imageSize, count, i, j;
+  long long size = -1;
+  if ((header = mapExecutable(&imageSize)) == NULL) {
+    return -1;
+  }
+  sections = (const ElfW(Shdr) *)((const char *)header + header->e_shoff);
+  for (i = 0; i < header->e_shnum && size < 0; i++) {
+    const ElfW(Sym) *symbols;
+    if (sections[i].sh_type != SHT_SYMTAB) {
+      continue;
+    }
+    symbols =
+        (const ElfW(Sym) *)((const char *)header + sections[i].sh_offset);
+    count = sections[i].sh_size / sizeof(ElfW(Sym));
+    for (j = 0; j < count; j++) {
+      // the type is the low four bits of st_info in both ELF classes
+      if (ELF64_ST_TYPE(symbols[j].st_info) == STT_FUNC &&
+          textBias + symbols[j].st_value == start) {
+        size = (long long)symbols[j].st_size;
+        break;
+      }
+    }
+  }
+  munmap((void *)header, imageSize);
+  return size;
+}
+
+static const char *methodContaining(uintptr_t pc) {
+  // the table is not sorted, so take the closest function that starts at or
+  // before pc. that is only the method pc is in if pc is in the executable's
+  // own code and, where the symbol table says how long the function is,
+  // before its end; otherwise the stack ran out in a shared library, in
+  // runtime.c or in a statically linked libc
+  const char *best = NULL;
+  uintptr_t bestStart = 0;
+  long long size;
+  unsigned int i;
+  if (pc < textLow || pc >= textHigh) {
+    return NULL;
+  }
+  for (i = 0; i < methodCount; i++) {
+    uintptr_t start = (uintptr_t)methodTable[i].address;
+    if (start <= pc && start >= bestStart) {
+      best = methodTable[i].name;
+      bestStart = start;
+    }
+  }
+  if (best != NULL && (size = functionSize(bestStart)) >= 0 &&
+      pc - bestStart >= (uintptr_t)size) {
+    return NULL;
+  }
+  return best;
+}
+
+static void writeString(const char *s) {
+  // the handler below reports with write() alone, which is async-signal-safe
+  ssize_t unused = write(STDERR_FILENO, s, strlen(s));
+  (void)unused;
+}
+
+static int resumeAtNullHandler(uintptr_t pc, void *context);
+static void writeTrace(void);
+
+static void faultHandler(int sig, siginfo_t *info, void *context) {
+  char *address = (char *)info->si_addr;
+  if (address >= guardLow && address < guardHigh) {
+    const char *name = methodContaining(faultingPC(context));
+    // keep what the program printed before it ran out of stack. this is the
+    // one call in the handler that is not async-signal-safe: the trylock
+    // skips it when the overflow happened inside stdio with stdout locked,
+    // but an overflow in stdio code that does not take the lock (or in
+    // malloc, below fflush) can still leave stdout half updated, and then
+    // the flush may print garbage or fault again. the process exits either
+    // way, and losing the output every time would be worse
+    if (ftrylockfile(stdout) == 0) {
+      fflush(stdout);
+      funlockfile(stdout);
+    }
+    writeString("stack exhausted at method ");
+    writeString(name ? name : "<unknown>");
+    writeString("\n");
+    writeTrace();
+    _exit(EXIT_FAILURE);
+  }
+  if ((uintptr_t)address < NULL_PAGE_SIZE &&
+      resumeAtNullHandler(faultingPC(context), context)) {
+    return;
+  }
+  // not ours: let the fault happen again with the default action
+  signal(sig, SIG_DFL);
+}
+
+static void installFaultHandler(void) {
+  static int installed = 0;
+  struct sigaction action;
+  stack_t altStack;
+  if (installed) {
+    return;
+  }
+  installed = 1;
+  // the handler cannot run on a stack that just overflowed
+  altStack.ss_sp = signalStack;
+  altStack.ss_size = SIGNAL_STACK_SIZE;
+  altStack.ss_flags = 0;
+  sigaltstack(&altStack, NULL);
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = faultHandler;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, NULL);
+  sigaction(SIGBUS, &action, NULL);
+}
+
+static void runEntry(void) { djResult = djEntry(); }
+
+static unsigned long long stackSizeFromEnvironment(unsigned long long size) {
+  const char *env = getenv("DJ_STACK_SIZE");
+  char *end;
+  unsigned long long mib;
+  if (env == NULL || *env == '\0') {
+    return size;
+  }
+  mib = strtoull(env, &end, 10);
+  if (*end != '\0' || mib == 0 || mib > DJ_MAX_STACK_MIB) {
+    fprintf(stderr,
+            "ignoring DJ_STACK_SIZE=%s: expected a number of MiB from 1 to "
+            "%llu\n",
+            env, DJ_MAX_STACK_MIB);
+    return size;
+  }
+  return mib << 20;
+}
+
+int dj_run_on_stack(int (*entry)(void), unsigned long long stackSize,
+                    const struct dj_method_info *methods,
+                    unsigned int numMethods) {
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  unsigned long long requested = stackSizeFromEnvironment(stackSize);
+  size_t size = (size_t)requested;
+  char *base;
+
+  // rounding up to a page and adding the guard region must not wrap
+  if (requested > (DJ_MAX_STACK_MIB << 20) ||
+      size > (size_t)-1 - pageSize - GUARD_SIZE) {
+    fprintf(stderr, "could not map a %llu byte stack: too large\n",
+            requested);
+    return EXIT_FAILURE;
+  }
+  size = (size + pageSize - 1) & ~(pageSize - 1);
+  // MAP_NORESERVE: only the pages the program actually touches are committed
+  base = mmap(NULL, size + GUARD_SIZE, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "could not map a %llu byte stack: %s\n",
+            (unsigned long long)size, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  // the stack grows down, so the guard region is the lowest part of the map
+  if (mprotect(base, GUARD_SIZE, PROT_NONE) != 0) {
+    fprintf(stderr, "could not protect the stack guard: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+  guardLow = base;
+  guardHigh = base + GUARD_SIZE;
+  methodTable = methods;
+  methodCount = numMethods;
+  dl_iterate_phdr(executableText, NULL);
+
+  installFaultHandler();
+
+  djEntry = entry;
+  getcontext(&djContext);
+  djContext.uc_stack.ss_sp = base + GUARD_SIZE;
+  djContext.uc_stack.ss_size = size;
+  djContext.uc_link = &callerContext;
+  makecontext(&djContext, runEntry, 0);
+  swapcontext(&callerContext, &djContext);
+  return djResult;
+}
+
+/* The fault map as LLVM lays it out (version 1), all little-endian. Each
+ * object file has one; the linker concatenates them, so with --incremental
+ * there is one per class, back to back:
+ *
+ *   uint8 version, uint8 reserved, uint16 reserved
+ *   uint32 numFunctions
+ *   numFunctions times:
+ *     uint64 functionAddress
+ *     uint32 numFaultingPCs, uint32 reserved
+ *     numFaultingPCs times:
+ *       uint32 faultKind, uint32 faultingPCOffset, uint32 handlerPCOffset
+ */
+static const unsigned char *faultMap = NULL;
+static const unsigned char *faultMapEnd = NULL;
+
+static uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static int resumeAtNullHandler(uintptr_t pc, void *context) {
+  const unsigned char *p = faultMap;
+  uint32_t numFunctions, i, j;
+  while (p != NULL && p + 8 <= faultMapEnd) {
+    if (p[0] == 0) {
+      // alignment padding between two objects' maps
+      p++;
+      continue;
+    }
+    if (p[0] != 1) {
+      return 0;
+    }
+    numFunctions = read32(p + 4);
+    p += 8;
+    for (i = 0; i < numFunctions && p + 16 <= faultMapEnd; i++) {
+      uintptr_t function = (uintptr_t)read64(p);
+      uint32_t numFaultingPCs = read32(p + 8);
+      p += 16;
+      for (j = 0; j < numFaultingPCs && p + 12 <= faultMapEnd; j++, p += 12) {
+        if (function + read32(p + 4) == pc) {
+          return setPC(context, function + read32(p + 8));
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static const unsigned char *findFaultMap(size_t *size) {
+  // the section is loaded with the program, but nothing in the program refers
+  // to it, so look up where it went in our own section headers
+  const unsigned char *found = NULL;
+  const ElfW(Ehdr) *header;
+  const ElfW(Shdr) *sections;
+  const char *names;
+  uintptr_t bias = 0;
+  size_t imageSize;
+  unsigned int i;
+  if ((header = mapExecutable(&imageSize)) == NULL) {
+    return NULL;
+  }
+  dl_iterate_phdr(executableLoadBias, &bias);
+  sections = (const ElfW(Shdr) *)((const char *)header + header->e_shoff);
+  names = (const char *)header + sections[header->e_shstrndx].sh_offset;
+  for (i = 0; i < header->e_shnum; i++) {
+    if ((sections[i].sh_flags & SHF_ALLOC) &&
+        strcmp(names + sections[i].sh_name, ".llvm_faultmaps") == 0) {
+      found = (const unsigned char *)(bias + sections[i].sh_addr);
+      *size = (size_t)sections[i].sh_size;
+      break;
+    }
+  }
+  munmap((void *)header, imageSize);
+  return found;
+}
+
+void dj_enable_null_checks(void) {
+  size_t size = 0;
+  faultMap = findFaultMap(&size);
+  faultMapEnd = faultMap == NULL ? NULL : faultMap + size;
+  installFaultHandler();
+}
+
+void dj_null_deref(unsigned int line, const char *method) {
+  fflush(stdout);
+  if (line != 0) {
+    fprintf(stderr, "null dereference in method %s at line %u\n", method, line);
+  } else {
+    fprintf(stderr, "null dereference in method %s\n", method);
+  }
+  exit(EXIT_FAILURE);
+}
+
+static const char *const *heapClassNames = NULL;
+static unsigned int heapNumClasses = 0;
+unsigned long long *dj_heap_objects = NULL;
+unsigned long long *dj_heap_bytes = NULL;
+static int heapStatsAsJSON = 0;
+
+static int compareHeapBytes(const void *a, const void *b) {
+  // largest first; ties in class order
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+  if (dj_heap_bytes[x] != dj_heap_bytes[y]) {
+    return dj_heap_bytes[x] < dj_heap_bytes[y] ? 1 : -1;
+  }
+  return x < y ? -1 : x > y;
+}
+
+static void printHeapStats(void) {
+  unsigned long long objects = 0, bytes = 0;
+  unsigned int *order, count = 0, i;
+  fflush(stdout);
+  order = malloc(heapNumClasses * sizeof(unsigned int));
+  if (order == NULL) {
+    return;
+  }
+  for (i = 0; i < heapNumClasses; i++) {
+    if (dj_heap_objects[i] != 0) {
+      order[count++] = i;
+      objects += dj_heap_objects[i];
+      bytes += dj_heap_bytes[i];
+    }
+  }
+  qsort(order, count, sizeof(unsigned int), compareHeapBytes);
+  if (heapStatsAsJSON) {
+    // class names are DJ identifiers, which need no escaping
+    fputs("{\"classes\": [", stderr);
+    for (i = 0; i < count; i++) {
+      fprintf(stderr, "%s\n  {\"class\": \"%s\", \"objects\": %llu, "
+                      "\"bytes\": %llu}",
+              i == 0 ? "" : ",", heapClassNames[order[i]],
+              dj_heap_objects[order[i]], dj_heap_bytes[order[i]]);
+    }
+    fprintf(stderr,
+            "],\n \"objects\": %llu, \"bytes\": %llu, \"peakBytes\": %llu}\n",
+            objects, bytes, bytes);
+  } else {
+    fprintf(stderr, "heap statistics:\n%-24s %14s %16s\n", "class", "objects",
+            "bytes");
+    for (i = 0; i < count; i++) {
+      fprintf(stderr, "%-24s %14llu %16llu\n", heapClassNames[order[i]],
+              dj_heap_objects[order[i]], dj_heap_bytes[order[i]]);
+    }
+    fprintf(stderr, "%-24s %14llu %16llu\n", "total", objects, bytes);
+    // nothing is ever freed, so the heap peaks at the total
+    fprintf(stderr, "peak heap: %llu bytes\n", bytes);
+  }
+  free(order);
+}
+
+void dj_enable_heap_stats(const char *const *classNames,
+                          unsigned int numClasses, int json) {
+  heapClassNames = classNames;
+  heapNumClasses = numClasses;
+  heapStatsAsJSON = json;
+  dj_heap_objects = calloc(numClasses, sizeof(unsigned long long));
+  dj_heap_bytes = calloc(numClasses, sizeof(unsigned long long));
+  if (dj_heap_objects == NULL || dj_heap_bytes == NULL) {
+    fputs("out of memory\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  atexit(printHeapStats);
+}
+
+struct dj_trace_event dj_trace_ring[DJ_TRACE_EVENTS];
+uint64_t dj_trace_count = 0;
+static const char *const *traceNames = NULL;
+static unsigned int traceNameCount = 0;
+static uint64_t traceStartTime = 0;
+static uint64_t traceStartNanoseconds = 0;
+static char traceFile[4096] = "dj-trace.json";
+
+static uint64_t monotonicNanoseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+// the output goes through a small buffer on the (signal) stack
+struct traceWriter {
+  int fd;
+  unsigned int used;
+  char buffer[4096];
+};
+
+static void traceFlush(struct traceWriter *out) {
+  unsigned int done = 0;
+  while (done < out->used) {
+    ssize_t wrote = write(out->fd, out->buffer + done, out->used - done);
+    if (wrote < 0 && errno == EINTR) {
+      continue;
+    }
+    if (wrote <= 0) {
+      break;
+    }
+    done += (unsigned int)wrote;
+  }
+  out->used = 0;
+}
+
+static void tracePut(struct traceWriter *out, const char *s) {
+  for (; *s != '\0'; s++) {
+    if (out->used == sizeof(out->buffer)) {
+      traceFlush(out);
+    }
+    out->buffer[out->used++] = *s;
+  }
+}
+
+static void tracePutNumber(struct traceWriter *out, uint64_t n,
+                           unsigned int minDigits) {
+  char digits[24];
+  unsigned int count = 0;
+  do {
+    digits[count++] = (char)('0' + n % 10);
+    n /= 10;
+  } while (n != 0 || count < minDigits);
+  while (count > 0) {
+    char c[2] = {digits[--count], '\0'};
+    tracePut(out, c);
+  }
+}
+
+static void writeTrace(void) {
+  // Chrome's JSON trace format, which Perfetto also reads: a B and an E event
+  // around every method call and an instant event for every dispatch, with
+  // time stamps in microseconds since dj_enable_tracing
+  struct traceWriter out;
+  uint64_t first, i, ticks, nanoseconds, depth = 0;
+  int comma = 0;
+  if (traceNames == NULL) {
+    return;
+  }
+  out.fd = open(traceFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out.fd < 0) {
+    writeString("cannot write the trace to ");
+    writeString(traceFile);
+    writeString("\n");
+    return;
+  }
+  out.used = 0;
+  // the counter ticks at a constant rate; measure it over the whole run
+  ticks = dj_trace_time() - traceStartTime;
+  nanoseconds = monotonicNanoseconds() - traceStartNanoseconds;
+  first = dj_trace_count > DJ_TRACE_EVENTS ? dj_trace_count - DJ_TRACE_EVENTS
+                                           : 0;
+  tracePut(&out, "{\"traceEvents\": [");
+  for (i = first; i < dj_trace_count; i++) {
+    const struct dj_trace_event *e = &dj_trace_ring[i & (DJ_TRACE_EVENTS - 1)];
+    unsigned int kind = e->event & 3;
+    uint64_t elapsed = e->time - traceStartTime;
+    if (kind == DJ_TRACE_END && depth == 0) {
+      // its B was overwritten when the ring wrapped around
+      continue;
+    }
+    if ((e->event >> 2) >= traceNameCount) {
+      continue;
+    }
+    if (kind == DJ_TRACE_BEGIN) {
+      depth++;
+    } else if (kind == DJ_TRACE_END) {
+      depth--;
+    }
+    if (ticks != 0) {
+      // to nanoseconds, without overflowing for runs of a few hours
+      elapsed = (uint64_t)((double)elapsed * nanoseconds / ticks);
+    }
+    tracePut(&out, comma ? ",\n" : "\n");
+    comma = 1;
+    tracePut(&out, "{\"name\": \"");
+    tracePut(&out, traceNames[e->event >> 2]);
+    tracePut(&out, kind == DJ_TRACE_BEGIN ? "\", \"ph\": \"B\""
+                   : kind == DJ_TRACE_END ? "\", \"ph\": \"E\""
+                                          : "\", \"cat\": \"dispatch\", "
+                                            "\"ph\": \"i\", \"s\": \"t\"");
+    tracePut(&out, ", \"ts\": ");
+    tracePutNumber(&out, elapsed / 1000, 1);
+    tracePut(&out, ".");
+    tracePutNumber(&out, elapsed % 1000, 3);
+    tracePut(&out, ", \"pid\": 1, \"tid\": 1}");
+  }
+  tracePut(&out, "\n]}\n");
+  traceFlush(&out);
+  close(out.fd);
+}
+
+static void traceSignalHandler(int sig) {
+  int saved = errno;
+  writeTrace();
+  errno = saved;
+  if (sig != SIGUSR1) {
+    signal(sig, SIG_DFL);
+    raise(sig);
+  }
+}
+
+void dj_enable_tracing(const char *const *names, unsigned int count) {
+  const char *file = getenv("DJ_TRACE_FILE");
+  struct sigaction action;
+  if (file != NULL && *file != '\0' && strlen(file) < sizeof(traceFile)) {
+    strcpy(traceFile, file);
+  }
+  traceNames = names;
+  traceNameCount = count;
+  traceStartNanoseconds = monotonicNanoseconds();
+  traceStartTime = dj_trace_time();
+  atexit(writeTrace);
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = traceSignalHandler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR1, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+}
+
+/* the out-of-line copies of the fast paths (see runtimeFastPaths.c) */
+#define DJ_RUNTIME_OBJECT
+#include "runtimeFastPaths.c"
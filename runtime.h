@@ -0,0 +1,89 @@
+#ifndef DJ2LL_RUNTIME_HEADER
+#define DJ2LL_RUNTIME_HEADER
+
+/* Runtime support for executables produced by dj2ll; the generated object
+ * files call into it. runtime.c is linked as an object. runtimeFastPaths.c,
+ * which defines the functions called on hot paths, is linked into every
+ * module as bitcode (see runtimeLink.cpp). dj2ll links runtime.c too, for the
+ * readNat() and null dereference handling of --interpret. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Implements readNat(). stdin is consumed in large blocks (or mmapped when it
+ * is a regular file) rather than through scanf. When prompt is nonzero and
+ * stdin is a terminal, "Enter a natural number: " is printed first. Returns 0
+ * once stdin is exhausted. */
+unsigned int dj_read_nat(int prompt);
+
+/* Implements printNat(): prints value and a newline to stdout. */
+void dj_print_nat(unsigned int value);
+
+/* Allocates size bytes for a new object. Exits with status 1 when out of
+ * memory. */
+void *dj_alloc(unsigned long long size);
+
+/* One entry of the table dj2ll emits when --stack-size is given: the address
+ * of a generated function and its DJ name ("C.m", or "main"). */
+struct dj_method_info {
+  const void *address;
+  const char *name;
+};
+
+/* The largest stack --stack-size and DJ_STACK_SIZE accept, in MiB (1 TiB).
+ * The stack is mapped with MAP_NORESERVE, so only touched pages cost memory;
+ * the cap keeps the size and its guard region far from overflowing. */
+#define DJ_MAX_STACK_MIB (1ull << 20)
+
+/* Runs entry on a freshly mapped stack of stackSize bytes (or DJ_STACK_SIZE
+ * MiB, when that environment variable is set) and returns its result. A fault
+ * in the guard region below the stack prints "stack exhausted at method X",
+ * where X is looked up in methods, and exits with status 1. */
+int dj_run_on_stack(int (*entry)(void), unsigned long long stackSize,
+                    const struct dj_method_info *methods,
+                    unsigned int numMethods);
+
+/* Called first thing by programs compiled with --null-checks. Locates the
+ * program's .llvm_faultmaps section and installs a SIGSEGV handler that sends
+ * faulting field accesses and dispatches on null to their null handlers. */
+void dj_enable_null_checks(void);
+
+/* The null handlers call this: report the DJ method and line (when known)
+ * that dereferenced null, then exit with status 1. */
+void dj_null_deref(unsigned int line, const char *method)
+    __attribute__((noreturn));
+
+/* Called first thing by programs compiled with --heap-stats. classNames
+ * holds the DJ name of every class, by class number. Registers an atexit
+ * handler that prints the objects and bytes allocated for each class, largest
+ * first, and the peak heap size to stderr; as JSON when json is nonzero. */
+void dj_enable_heap_stats(const char *const *classNames,
+                          unsigned int numClasses, int json);
+
+/* Every `new` in a --heap-stats program calls this with the class it
+ * instantiates and the size of that class's struct. DJ programs never free
+ * an object, so the peak heap size is the total allocated so far. */
+void dj_count_allocation(unsigned int classNum, unsigned long long size);
+
+/* What a --trace event records, in the low two bits of its event number; the
+ * rest is the index of the method in the table given to dj_enable_tracing. */
+#define DJ_TRACE_BEGIN 0
+#define DJ_TRACE_END 1
+#define DJ_TRACE_DISPATCH 2
+
+/* Called first thing by programs compiled with --trace. names holds the DJ
+ * name of every traced method ("C.m"), with main first. The last events are
+ * written as Chrome trace JSON to $DJ_TRACE_FILE, or dj-trace.json, at exit,
+ * on SIGUSR1 (and the program carries on), on SIGINT and SIGTERM, and when
+ * the stack is exhausted. */
+void dj_enable_tracing(const char *const *names, unsigned int count);
+
+/* Records event, stamped with the time stamp counter, in a ring buffer that
+ * keeps the most recent 2^20 events. */
+void dj_trace(unsigned int event);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // DJ2LL_RUNTIME_HEADER
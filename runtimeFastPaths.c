@@ -0,0 +1,80 @@
+/*
+** runtimeFastPaths.c
+**
+** The part of the runtime that generated code calls on its hot paths: every
+** printNat(), every `new`, and the --heap-stats and --trace hooks. The build
+** compiles this file to bitcode and embeds it in dj2ll (runtimeBitcode.S),
+** and dj2ll links it into each module before optimizing (runtimeLink.cpp).
+** There the functions become internal, so the ones marked FAST_PATH are
+** inlined into DJ methods and the rest are dropped when unused.
+**
+** Nothing here may be needed by runtime.c itself: once linked, these
+** functions are private to the program's module.
+**
+** runtime.c also includes this file, with DJ_RUNTIME_OBJECT defined, to give
+** runtime.o weak out-of-line copies of every function. They are what
+** modules for another target than dj2ll's call, since the bitcode is only
+** linked into modules for the machine it was compiled for; anywhere else,
+** the linked copies win.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "runtime.h"
+#include "runtimeInternal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef DJ_RUNTIME_OBJECT
+#define EXPORTED __attribute__((weak))
+#define FAST_PATH EXPORTED
+#else
+#define EXPORTED
+#define FAST_PATH __attribute__((always_inline))
+#endif
+
+static __attribute__((noinline, cold, noreturn)) void outOfMemory(void) {
+  fflush(stdout);
+  fputs("out of memory\n", stderr);
+  exit(EXIT_FAILURE);
+}
+
+EXPORTED void dj_print_nat(unsigned int value) {
+  // what printf("%u\n") printed, without parsing a format on every call
+  char digits[11];
+  char *start = digits + sizeof(digits);
+  *--start = '\n';
+  do {
+    *--start = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+#ifdef __GLIBC__
+  fwrite_unlocked(start, 1, (size_t)(digits + sizeof(digits) - start), stdout);
+#else
+  fwrite(start, 1, (size_t)(digits + sizeof(digits) - start), stdout);
+#endif
+}
+
+FAST_PATH void *dj_alloc(unsigned long long size) {
+  void *object = malloc(size);
+  if (__builtin_expect(object == NULL, 0)) {
+    outOfMemory();
+  }
+  return object;
+}
+
+FAST_PATH void dj_count_allocation(unsigned int classNum,
+                                   unsigned long long size) {
+  dj_heap_objects[classNum]++;
+  dj_heap_bytes[classNum] += size;
+}
+
+FAST_PATH void dj_trace(unsigned int event) {
+  struct dj_trace_event *slot =
+      &dj_trace_ring[dj_trace_count & (DJ_TRACE_EVENTS - 1)];
+  slot->time = dj_trace_time();
+  slot->event = event;
+  dj_trace_count++;
+}
@@ -0,0 +1,42 @@
+#ifndef DJ2LL_RUNTIME_INTERNAL_HEADER
+#define DJ2LL_RUNTIME_INTERNAL_HEADER
+
+/* What runtime.c shares with runtimeFastPaths.c: the counters that the fast
+ * paths update inline in the generated code and that runtime.c reports. Not
+ * part of the interface the generated code uses; that is runtime.h. */
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* --heap-stats: objects and bytes allocated, by class number */
+extern unsigned long long *dj_heap_objects;
+extern unsigned long long *dj_heap_bytes;
+
+/* --trace: the ring buffer of the last DJ_TRACE_EVENTS events. dj_trace_count
+ * counts every event recorded; the next one goes in slot
+ * dj_trace_count % DJ_TRACE_EVENTS */
+#define DJ_TRACE_EVENTS (1 << 20)
+
+struct dj_trace_event {
+  uint64_t time;
+  unsigned int event;
+};
+
+extern struct dj_trace_event dj_trace_ring[DJ_TRACE_EVENTS];
+extern uint64_t dj_trace_count;
+
+/* the time stamp counter, or nanoseconds where there is none */
+static inline uint64_t dj_trace_time(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+#endif // DJ2LL_RUNTIME_INTERNAL_HEADER
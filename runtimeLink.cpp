@@ -0,0 +1,77 @@
+/*
+** runtimeLink.cpp
+**
+** The bitcode of runtimeFastPaths.c is part of dj2ll itself, between the
+** symbols runtimeBitcode.S defines, so there is no file to find at run time
+** and it always matches the dj2ll that generated the calls to it.
+**
+** Only the functions the module declares are linked (LinkOnlyNeeded), which
+** keeps programs that never use --trace or --heap-stats free of their hooks.
+**
+** The bitcode is C preprocessed for the machine dj2ll was built on (it reads
+** the time stamp counter on x86, and picks stdio functions by libc), so it is
+** only linked into modules for that same triple. A module for any other
+** target keeps its calls external, and they resolve to the out-of-line
+** copies in the runtime.o built for that target.
+*/
+
+#include "runtimeLink.hpp"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+
+using namespace llvm;
+
+extern "C" const char dj_runtime_bitcode[];
+extern "C" const char dj_runtime_bitcode_end[];
+
+bool linkRuntime(Module &M, bool internalize) {
+  size_t size = dj_runtime_bitcode_end - dj_runtime_bitcode;
+  MemoryBufferRef bitcode(StringRef(dj_runtime_bitcode, size),
+                          "runtimeFastPaths.bc");
+  auto runtime = parseBitcodeFile(bitcode, M.getContext());
+  if (!runtime) {
+    logAllUnhandledErrors(runtime.takeError(), errs(), "dj2ll: ");
+    exit(-1);
+  }
+  Triple built((*runtime)->getTargetTriple());
+  Triple target(M.getTargetTriple());
+  if (built.getArch() != target.getArch() || built.getOS() != target.getOS() ||
+      built.getEnvironment() != target.getEnvironment()) {
+    return false;
+  }
+  // same machine, but the bitcode was tuned for the build host's CPU; let the
+  // fast paths take on M's CPU and features instead, which also keeps the
+  // inliner from refusing them over mismatched features. the vendor part of
+  // the triple may still differ, so take M's spelling of it
+  (*runtime)->setTargetTriple(M.getTargetTriple());
+  (*runtime)->setDataLayout(M.getDataLayout());
+  for (auto &F : **runtime) {
+    F.removeFnAttr("target-cpu");
+    F.removeFnAttr("target-features");
+    F.removeFnAttr("tune-cpu");
+  }
+  std::function<void(Module &, const StringSet<> &)> makeInternal;
+  if (internalize) {
+    makeInternal = [](Module &Linked, const StringSet<> &names) {
+      for (const auto &name : names) {
+        if (auto GV = Linked.getNamedValue(name.getKey())) {
+          GV->setLinkage(GlobalValue::InternalLinkage);
+        }
+      }
+    };
+  }
+  if (Linker::linkModules(M, std::move(*runtime), Linker::Flags::LinkOnlyNeeded,
+                          makeInternal)) {
+    errs() << "dj2ll: cannot link the runtime into " << M.getName() << "\n";
+    exit(-1);
+  }
+  if (internalize) {
+    // also deletes the fast paths once nothing calls them
+    legacy::PassManager MPM;
+    MPM.add(createAlwaysInlinerLegacyPass());
+    MPM.run(M);
+  }
+  return true;
+}
@@ -0,0 +1,16 @@
+#ifndef RUNTIMELINK_H
+#define RUNTIMELINK_H
+/*links the runtime's fast paths (runtimeFastPaths.c), which the build embeds
+ * in dj2ll as bitcode, into the modules dj2ll generates*/
+
+#include "llvm_includes.hpp"
+
+// links in the runtime functions that M declares. with internalize, they
+// become private to M and the ones marked FAST_PATH are inlined into their
+// callers right away. without it (--incremental, where every part must be
+// able to call them) they stay external and end up in the part holding main.
+// returns false, and links nothing, when M is for another target than the
+// bitcode; the calls then go to the copies in runtime.o
+bool linkRuntime(llvm::Module &M, bool internalize);
+
+#endif // __RUNTIMELINK_H_
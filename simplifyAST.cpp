@@ -0,0 +1,279 @@
+/*
+** simplifyAST.cpp
+**
+** Constant folding and expression simplification on the LLAST. Everything
+** here is a plain tree rewrite: no LLVM types are involved, and the type
+** checker has already run, so the only job is to keep DJ semantics intact:
+**
+**     * nat arithmetic wraps at 32 bits, exactly like the add/sub/mul that
+**       codeGen emits
+**     * && short-circuits, so `false && e` never evaluates e
+**     * an expression list evaluates to its last expression, so only the
+**       last expression's value is ever observed
+**
+** An `if` whose condition folds to a literal is replaced by the expressions
+** of the branch that would run. That is only possible when the `if` is a
+** member of an expression list; everywhere else it keeps its shape and only
+** its children are simplified.
+*/
+
+#include "simplifyAST.hpp"
+#include "llast.hpp"
+#include <cstdint>
+
+static bool natLiteral(DJExpression *e, unsigned int &value) {
+  if (auto nat = dynamic_cast<DJNat *>(e)) {
+    value = nat->value;
+    return true;
+  }
+  return false;
+}
+
+// returns 1 for `true`, 0 for `false`, and -1 for anything else
+static int boolLiteral(DJExpression *e) {
+  if (dynamic_cast<DJTrue *>(e)) {
+    return 1;
+  }
+  if (dynamic_cast<DJFalse *>(e)) {
+    return 0;
+  }
+  return -1;
+}
+
+static DJExpression *makeBool(bool value) {
+  if (value) {
+    return new DJTrue();
+  }
+  return new DJFalse();
+}
+
+bool isPure(DJExpression *e) {
+  // an expression is pure if evaluating it cannot print, read, allocate,
+  // store, call a method, or fault. field loads through a DJDotId may
+  // dereference null, so they are not considered pure
+  if (dynamic_cast<DJNat *>(e) || dynamic_cast<DJTrue *>(e) ||
+      dynamic_cast<DJFalse *>(e) || dynamic_cast<DJNull *>(e) ||
+      dynamic_cast<DJId *>(e) || dynamic_cast<DJThis *>(e)) {
+    return true;
+  }
+  if (dynamic_cast<DJPlus *>(e) || dynamic_cast<DJMinus *>(e) ||
+      dynamic_cast<DJTimes *>(e) || dynamic_cast<DJNot *>(e) ||
+      dynamic_cast<DJEqual *>(e) || dynamic_cast<DJGreater *>(e) ||
+      dynamic_cast<DJAnd *>(e) || dynamic_cast<DJInstanceOf *>(e)) {
+    for (auto child : e->children()) {
+      if (!isPure(child)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+static DJExpression *simplifyPlus(DJPlus *e) {
+  e->lhs = simplifyExpr(e->lhs);
+  e->rhs = simplifyExpr(e->rhs);
+  unsigned int l, r;
+  bool lConst = natLiteral(e->lhs, l);
+  bool rConst = natLiteral(e->rhs, r);
+  if (lConst && rConst) {
+    return new DJNat(static_cast<uint32_t>(l + r));
+  }
+  if (lConst && l == 0) {
+    return e->rhs;
+  }
+  if (rConst && r == 0) {
+    return e->lhs;
+  }
+  return e;
+}
+
+static DJExpression *simplifyMinus(DJMinus *e) {
+  e->lhs = simplifyExpr(e->lhs);
+  e->rhs = simplifyExpr(e->rhs);
+  unsigned int l, r;
+  bool lConst = natLiteral(e->lhs, l);
+  bool rConst = natLiteral(e->rhs, r);
+  if (lConst && rConst) {
+    return new DJNat(static_cast<uint32_t>(l - r));
+  }
+  if (rConst && r == 0) {
+    return e->lhs;
+  }
+  return e;
+}
+
+static DJExpression *simplifyTimes(DJTimes *e) {
+  e->lhs = simplifyExpr(e->lhs);
+  e->rhs = simplifyExpr(e->rhs);
+  unsigned int l, r;
+  bool lConst = natLiteral(e->lhs, l);
+  bool rConst = natLiteral(e->rhs, r);
+  if (lConst && rConst) {
+    return new DJNat(static_cast<uint32_t>(l * r));
+  }
+  if (lConst && l == 1) {
+    return e->rhs;
+  }
+  if (rConst && r == 1) {
+    return e->lhs;
+  }
+  if ((lConst && l == 0 && isPure(e->rhs)) ||
+      (rConst && r == 0 && isPure(e->lhs))) {
+    return new DJNat(0);
+  }
+  return e;
+}
+
+static DJExpression *simplifyNot(DJNot *e) {
+  e->negated = simplifyExpr(e->negated);
+  int b = boolLiteral(e->negated);
+  if (b != -1) {
+    return makeBool(!b);
+  }
+  if (auto inner = dynamic_cast<DJNot *>(e->negated)) {
+    return inner->negated;
+  }
+  return e;
+}
+
+static DJExpression *simplifyEqual(DJEqual *e) {
+  e->lhs = simplifyExpr(e->lhs);
+  e->rhs = simplifyExpr(e->rhs);
+  if (e->hasNullChild) {
+    // leave null comparisons alone; codeGen needs the null's static type
+    return e;
+  }
+  unsigned int l, r;
+  if (natLiteral(e->lhs, l) && natLiteral(e->rhs, r)) {
+    return makeBool(l == r);
+  }
+  int lb = boolLiteral(e->lhs);
+  int rb = boolLiteral(e->rhs);
+  if (lb != -1 && rb != -1) {
+    return makeBool(lb == rb);
+  }
+  return e;
+}
+
+static DJExpression *simplifyGreater(DJGreater *e) {
+  e->lhs = simplifyExpr(e->lhs);
+  e->rhs = simplifyExpr(e->rhs);
+  unsigned int l, r;
+  if (natLiteral(e->lhs, l) && natLiteral(e->rhs, r)) {
+    return makeBool(l > r);
+  }
+  return e;
+}
+
+static DJExpression *simplifyAnd(DJAnd *e) {
+  e->lhs = simplifyExpr(e->lhs);
+  e->rhs = simplifyExpr(e->rhs);
+  int lb = boolLiteral(e->lhs);
+  int rb = boolLiteral(e->rhs);
+  if (lb == 1) {
+    return e->rhs;
+  }
+  if (lb == 0) {
+    // short-circuit: the right-hand side is never evaluated
+    return e->lhs;
+  }
+  if (rb == 1) {
+    return e->lhs;
+  }
+  if (rb == 0 && isPure(e->lhs)) {
+    return e->rhs;
+  }
+  return e;
+}
+
+DJExpression *simplifyExpr(DJExpression *e) {
+  if (auto plus = dynamic_cast<DJPlus *>(e)) {
+    return simplifyPlus(plus);
+  }
+  if (auto minus = dynamic_cast<DJMinus *>(e)) {
+    return simplifyMinus(minus);
+  }
+  if (auto times = dynamic_cast<DJTimes *>(e)) {
+    return simplifyTimes(times);
+  }
+  if (auto notExpr = dynamic_cast<DJNot *>(e)) {
+    return simplifyNot(notExpr);
+  }
+  if (auto equal = dynamic_cast<DJEqual *>(e)) {
+    return simplifyEqual(equal);
+  }
+  if (auto greater = dynamic_cast<DJGreater *>(e)) {
+    return simplifyGreater(greater);
+  }
+  if (auto andExpr = dynamic_cast<DJAnd *>(e)) {
+    return simplifyAnd(andExpr);
+  }
+  if (auto ifExpr = dynamic_cast<DJIf *>(e)) {
+    ifExpr->cond = simplifyExpr(ifExpr->cond);
+    ifExpr->thenBlock = simplifyExprList(ifExpr->thenBlock);
+    ifExpr->elseBlock = simplifyExprList(ifExpr->elseBlock);
+    return ifExpr;
+  }
+  if (auto forExpr = dynamic_cast<DJFor *>(e)) {
+    // a for loop always evaluates to 0, so nothing in its body, its init or
+    // its update is ever used as a value
+    forExpr->init = simplifyExpr(forExpr->init);
+    forExpr->test = simplifyExpr(forExpr->test);
+    forExpr->update = simplifyExpr(forExpr->update);
+    forExpr->body = simplifyExprList(forExpr->body, false);
+    return forExpr;
+  }
+  if (auto print = dynamic_cast<DJPrint *>(e)) {
+    print->printee = simplifyExpr(print->printee);
+  } else if (auto assign = dynamic_cast<DJAssign *>(e)) {
+    assign->RHS = simplifyExpr(assign->RHS);
+  } else if (auto dotId = dynamic_cast<DJDotId *>(e)) {
+    dotId->objectLike = simplifyExpr(dotId->objectLike);
+  } else if (auto dotAssign = dynamic_cast<DJDotAssign *>(e)) {
+    dotAssign->objectLike = simplifyExpr(dotAssign->objectLike);
+    dotAssign->assignVal = simplifyExpr(dotAssign->assignVal);
+  } else if (auto instanceOf = dynamic_cast<DJInstanceOf *>(e)) {
+    instanceOf->objectLike = simplifyExpr(instanceOf->objectLike);
+  } else if (auto dotCall = dynamic_cast<DJDotMethodCall *>(e)) {
+    dotCall->objectLike = simplifyExpr(dotCall->objectLike);
+    dotCall->methodParameter = simplifyExpr(dotCall->methodParameter);
+  } else if (auto undotCall = dynamic_cast<DJUndotMethodCall *>(e)) {
+    undotCall->methodParameter = simplifyExpr(undotCall->methodParameter);
+  }
+  return e;
+}
+
+ExprList simplifyExprList(ExprList exprs, bool lastValueUsed) {
+  ExprList simplified;
+  for (auto e : exprs) {
+    e = simplifyExpr(e);
+    auto ifExpr = dynamic_cast<DJIf *>(e);
+    int taken = ifExpr ? boolLiteral(ifExpr->cond) : -1;
+    if (taken != -1) {
+      // the branches were simplified along with the `if`; splice the one that
+      // runs into this list. its last expression is the value of the `if`
+      auto &block = taken ? ifExpr->thenBlock : ifExpr->elseBlock;
+      simplified.insert(simplified.end(), block.begin(), block.end());
+    } else {
+      simplified.push_back(e);
+    }
+  }
+  // drop pure expressions whose values are thrown away, i.e. everything but
+  // the value of the list itself
+  ExprList ret;
+  for (size_t i = 0; i < simplified.size(); i++) {
+    bool isValueOfList = lastValueUsed && i + 1 == simplified.size();
+    if (isValueOfList || !isPure(simplified[i])) {
+      ret.push_back(simplified[i]);
+    }
+  }
+  return ret;
+}
+
+void simplifyProgram(DJProgram &program) {
+  program.mainExprs = simplifyExprList(program.mainExprs);
+  for (auto &body : program.methodBodies) {
+    body.second = simplifyExprList(body.second);
+  }
+}
@@ -0,0 +1,18 @@
+#ifndef SIMPLIFYAST_H
+#define SIMPLIFYAST_H
+/*an LLAST-to-LLAST pass that runs between translateAST and DJProgram::codeGen.
+ * it folds constant expressions, drops side-effect-free expressions whose
+ * values are never used, and prunes DJIf branches with literal conditions, so
+ * less IR reaches the LLVM passes*/
+
+#include "llast.hpp"
+
+void simplifyProgram(DJProgram &program);
+
+ExprList simplifyExprList(ExprList exprs, bool lastValueUsed = true);
+
+DJExpression *simplifyExpr(DJExpression *e);
+
+bool isPure(DJExpression *e);
+
+#endif // __SIMPLIFYAST_H_
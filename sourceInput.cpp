@@ -0,0 +1,151 @@
+/*
+** sourceInput.cpp
+**
+** flex can scan a buffer in place when its last two bytes are NUL
+** (yy_scan_buffer). A single source file is mapped privately and writably,
+** because flex writes into the buffer it scans. An anonymous mapping sits
+** right behind the file to supply the two NULs even when the file ends on a
+** page boundary, so the file is never copied or read through stdio.
+**
+** With library files the sources are copied, in order, into one anonymous
+** mapping. Every file is made to end in a newline so that each one starts on
+** a fresh line. The line each file starts on is recorded for sourceLine().
+*/
+
+#include "sourceInput.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern "C" YY_BUFFER_STATE yy_scan_buffer(char *base, size_t size);
+
+struct SourceFile {
+  std::string path;
+  unsigned int firstLine; // in the combined source
+};
+
+static std::vector<SourceFile> sources;
+static std::pair<const char *, size_t> text;
+
+static size_t pageRound(size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (size + page - 1) / page * page;
+}
+
+static int openSource(const std::string &path, size_t &size) {
+  struct stat st;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    printf("ERROR: could not open file %s\n", path.c_str());
+    exit(-1);
+  }
+  size = st.st_size;
+  return fd;
+}
+
+static char *reserve(size_t size) {
+  // zero-filled, so whatever the sources do not cover reads as NUL
+  void *map = mmap(nullptr, pageRound(size), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    exit(-1);
+  }
+  return (char *)map;
+}
+
+static void scan(char *buffer, size_t size) {
+  // size counts the two NULs that end the buffer
+  text = {buffer, size - 2};
+  if (yy_scan_buffer(buffer, size) == nullptr) {
+    printf("ERROR: the scanner rejected the source buffer\n");
+    exit(-1);
+  }
+}
+
+static void loadSingleSource(const std::string &path) {
+  size_t size;
+  int fd = openSource(path, size);
+  char *buffer = reserve(size + 2);
+  if (size > 0 && mmap(buffer, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    perror(path.c_str());
+    exit(-1);
+  }
+  close(fd);
+  madvise(buffer, size, MADV_SEQUENTIAL);
+  scan(buffer, size + 2);
+}
+
+void loadSources(const std::vector<std::string> &libraries,
+                 const std::string &mainFile) {
+  sources.clear();
+  if (libraries.empty()) {
+    sources.push_back({mainFile, 1});
+    loadSingleSource(mainFile);
+    return;
+  }
+  auto paths = libraries;
+  paths.push_back(mainFile);
+  std::vector<int> fds;
+  std::vector<size_t> sizes;
+  size_t total = 0;
+  for (const auto &path : paths) {
+    size_t size;
+    fds.push_back(openSource(path, size));
+    sizes.push_back(size);
+    total += size + 1; // room for a missing final newline
+  }
+  char *buffer = reserve(total + 2);
+  char *end = buffer;
+  unsigned int line = 1;
+  for (size_t i = 0; i < paths.size(); i++) {
+    sources.push_back({paths[i], line});
+    if (sizes[i] > 0) {
+      void *file = mmap(nullptr, sizes[i], PROT_READ, MAP_PRIVATE, fds[i], 0);
+      if (file == MAP_FAILED) {
+        perror(paths[i].c_str());
+        exit(-1);
+      }
+      memcpy(end, file, sizes[i]);
+      munmap(file, sizes[i]);
+    }
+    close(fds[i]);
+    line += std::count(end, end + sizes[i], '\n');
+    end += sizes[i];
+    if (sizes[i] > 0 && end[-1] != '\n') {
+      *end++ = '\n';
+      line++;
+    }
+  }
+  scan(buffer, (end - buffer) + 2);
+}
+
+std::pair<const char *, size_t> sourceText() { return text; }
+
+std::pair<std::string, unsigned int> sourceLine(unsigned int line) {
+  if (sources.empty() || line == 0) {
+    return {sources.empty() ? "" : sources.back().path, line};
+  }
+  // the last file that starts at or before line
+  auto file = std::upper_bound(sources.begin(), sources.end(), line,
+                               [](unsigned int l, const SourceFile &f) {
+                                 return l < f.firstLine;
+                               });
+  --file;
+  return {file->path, line - file->firstLine + 1};
+}
+
+std::vector<std::pair<std::string, unsigned int>> sourceFiles() {
+  std::vector<std::pair<std::string, unsigned int>> ret;
+  for (const auto &file : sources) {
+    ret.push_back({file.path, file.firstLine});
+  }
+  return ret;
+}
@@ -0,0 +1,26 @@
+#ifndef SOURCEINPUT_H
+#define SOURCEINPUT_H
+/*hands the DJ source to the scanner as one memory-mapped buffer instead of
+ * through yyin. a program may be split over several files: class libraries
+ * followed by the file with the main block. the scanner sees them as one
+ * source, so sourceLine() turns its line numbers back into (file, line)*/
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// libraries come before mainFile in the combined source, in the given order
+void loadSources(const std::vector<std::string> &libraries,
+                 const std::string &mainFile);
+
+// the combined source exactly as it is handed to the scanner; only valid until
+// yyparse runs, because flex writes into the buffer it scans
+std::pair<const char *, size_t> sourceText();
+
+// the file holding line `line` of the combined source, and the line within it
+std::pair<std::string, unsigned int> sourceLine(unsigned int line);
+
+// every file of the program with the line of the combined source it starts on
+std::vector<std::pair<std::string, unsigned int>> sourceFiles();
+
+#endif // __SOURCEINPUT_H_
@@ -0,0 +1,89 @@
+/*
+** tailCalls.cpp
+**
+** DJ has no while loop, so recursive methods are the usual way to walk a data
+** structure. Every call goes through a VTable thunk, which keeps the backend
+** from ever turning one into a jump, and deep recursion runs out of stack.
+**
+** A call is in tail position when its value is the value of the method: it
+** is the last expression of the method body, or the last expression of
+** either branch of an `if` that is itself in tail position. For such calls we
+** also try to find the single method the call can reach. Every dynamic class
+** that could be the receiver (every subtype of the static class, or only the
+** instantiated ones when rapid type analysis has run) must dispatch to the
+** same method. When the target is the calling method itself, codeGen stores
+** the new receiver and argument and branches back to the top of the method
+** instead of calling, so recursion depth is bounded by the data, not by the
+** stack.
+*/
+
+#include "tailCalls.hpp"
+#include "codeGenClass.hpp"
+#include "llast.hpp"
+#include <string>
+#include <utility>
+
+static std::pair<int, int> findSingleTarget(DJProgram &program,
+                                            int staticClass, int staticMethod) {
+  std::pair<int, int> target = {-1, -1};
+  for (int j = 1; j < numClasses; j++) {
+    if (!isSubtype(j, staticClass) ||
+        (program.pruneUnreachable && !program.instantiatedClasses.count(j))) {
+      continue;
+    }
+    auto dynamicTarget = getDynamicMethodInfo(staticClass, j, staticMethod);
+    if (target.first == -1) {
+      target = dynamicTarget;
+    } else if (target != dynamicTarget) {
+      return {-1, -1};
+    }
+  }
+  return target;
+}
+
+template <typename Call>
+static bool markCall(DJProgram &program, Call *call, int classNum,
+                     int methodNum) {
+  // returns true iff the call is a self-recursive call we can turn into a jump
+  call->isTailCall = true;
+  auto [targetClass, targetMethod] = findSingleTarget(
+      program, call->staticClassNum, call->staticMemberNum);
+  call->targetClass = targetClass;
+  call->targetMethod = targetMethod;
+  return targetClass == classNum && targetMethod == methodNum;
+}
+
+static bool markTailPosition(DJProgram &program, const ExprList &exprs,
+                             int classNum, int methodNum) {
+  if (exprs.empty()) {
+    return false;
+  }
+  auto last = exprs.back();
+  if (auto ifExpr = dynamic_cast<DJIf *>(last)) {
+    bool inThen =
+        markTailPosition(program, ifExpr->thenBlock, classNum, methodNum);
+    bool inElse =
+        markTailPosition(program, ifExpr->elseBlock, classNum, methodNum);
+    return inThen || inElse;
+  }
+  if (auto dotCall = dynamic_cast<DJDotMethodCall *>(last)) {
+    return markCall(program, dotCall, classNum, methodNum);
+  }
+  if (auto undotCall = dynamic_cast<DJUndotMethodCall *>(last)) {
+    return markCall(program, undotCall, classNum, methodNum);
+  }
+  return false;
+}
+
+void markTailCalls(DJProgram &program) {
+  program.selfTailRecursive.clear();
+  for (int i = 0; i < numClasses; i++) {
+    for (int j = 0; j < classesST[i].numMethods; j++) {
+      auto methodName = std::string(classesST[i].className) + "_method_" +
+                        classesST[i].methodList[j].methodName;
+      if (markTailPosition(program, program.methodBodies[methodName], i, j)) {
+        program.selfTailRecursive.insert(methodName);
+      }
+    }
+  }
+}
@@ -0,0 +1,11 @@
+#ifndef TAILCALLS_H
+#define TAILCALLS_H
+/*finds method calls in tail position on the LLAST. tail calls whose target is
+ * known statically are generated as direct `tail` calls, and self-recursive
+ * ones become a jump back to the top of the method*/
+
+#include "llast.hpp"
+
+void markTailCalls(DJProgram &program);
+
+#endif // __TAILCALLS_H_
@@ -1,6 +1,7 @@
 #!/usr/bin/env python3
 
 import os
+import subprocess
 import sys
 from pygments import highlight
 from pygments.lexers import JavaLexer
@@ -12,6 +13,50 @@ vtable = ["good08.dj", "good09.dj", "good19.dj", "good33.dj"]
 
 null = ["good10.dj", "good27.dj", "good24.dj", "good29.dj", "good31.dj"]
 
+# object layout; these also run under --interpret to compare the two outputs
+fields = ["good35.dj", "good36.dj", "good37.dj"]
+
+# self tail calls too deep for the stack; these also run under --interpret
+# and --tiered, whose JIT must loop back too
+tail_calls = ["good38.dj"]
+
+# null dereferences; these are checked against their "correct output" and
+# "stderr" comments when built with --null-checks, with --null-checks
+# --incremental, and under --interpret
+null_checks = ["good39.dj"]
+
+
+def expected(source, key):
+    # the text after "// key: " in the program's header comment
+    for line in source.splitlines():
+        if line.startswith(f"// {key}: "):
+            return line[len(f"// {key}: "):].strip()
+    return ""
+
+
+def check_null_dereference(file, source):
+    fileName = f"test_programs/good/{file}"
+    output = expected(source, "correct output").split()
+    message = expected(source, "stderr")
+    for flags in [["--null-checks"], ["--null-checks", "--incremental"], []]:
+        if flags:
+            subprocess.run(["./dj2ll", fileName] + flags, check=True)
+            command = [f"./{file[0:-3]}"]
+        else:
+            command = ["./dj2ll", fileName, "--interpret"]
+        result = subprocess.run(command, capture_output=True, text=True)
+        passed = (
+            result.returncode != 0
+            and result.stdout.split() == output
+            and message in result.stderr
+        )
+        name = " ".join(flags) if flags else "--interpret"
+        print(f"{'PASS' if passed else 'FAIL'} {name}")
+        if not passed:
+            print(f"status {result.returncode}")
+            print(result.stdout + result.stderr)
+    os.system(f"rm -rf {fileName}.djcache")
+
 
 def main():
     if len(sys.argv) == 1:
@@ -21,17 +66,33 @@ def main():
         files = undotted_method_call
     elif sys.argv[1] == "vt":
         files = vtable
+    elif sys.argv[1] == "fl":
+        files = fields
+    elif sys.argv[1] == "tc":
+        files = tail_calls
+    elif sys.argv[1] == "nc":
+        files = null_checks
     for file in files:
         fileName = f"test_programs/good/{file}"
         with open(fileName) as f:
             infoStr = f"File = {file}"
             asterisks = len(infoStr) * "*"
             print(f"{asterisks}\n{infoStr}\n{asterisks}")
-            print(highlight(f.read(), JavaLexer(), T256F(style="monokai")))
+            source = f.read()
+            print(highlight(source, JavaLexer(), T256F(style="monokai")))
+            if file in null_checks:
+                check_null_dereference(file, source)
+                print(asterisks)
             os.system(f"./dj2ll {fileName}")
             print(asterisks)
             os.system(f"./{file[0:-3]}")
             print(asterisks)
+            if file in fields + tail_calls:
+                os.system(f"./dj2ll {fileName} --interpret")
+                print(asterisks)
+            if file in tail_calls:
+                os.system(f"./dj2ll {fileName} --tiered")
+                print(asterisks)
             reply = str(input("(press [enter] to continue):")).strip()
             if reply != "":
                 break